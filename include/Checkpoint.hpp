@@ -0,0 +1,101 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include "Type.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Checkpoint files: a header page describing the state, followed by the raw f_q's of the lattice.
+//
+//  [0, 4096)          CheckpointHeader, the rest of the page is 0
+//  [4096, 4096 + n)   the n bytes of the lattice data, in the layout and storage type of the header
+//
+// The header tells everything needed to check that a checkpoint fits a simulation: the version
+// of the format, the byte order, the lattice (size, layout, storage type, propagation), the time
+// step and the constants derived by Parameters. Header and data are protected by checksums.
+//
+// The files are written and read through memory mappings, i.e. the data is copied once between
+// the lattice and the page cache and goes to the disk in one sequential stream. The copy and
+// the checksum are done in the same pass, by all threads. A checkpoint is written to
+// <path>.tmp first and renamed to path when it is on the disk, so the last complete checkpoint
+// survives a crash while the next one is written.
+//
+// Errors (the file can't be written, doesn't exist, is corrupt or of another version) are
+// reported as std::runtime_error.
+
+#define CHECKPOINT_VERSION 1
+
+// Size of the header page, the data starts page aligned after it
+#define CHECKPOINT_HEADER_SIZE 4096
+
+struct CheckpointHeader {
+    char magic[8];              // "LBMCKPT"
+    uint32_t version;           // CHECKPOINT_VERSION
+    uint32_t byteOrder;         // 0x01020304 as written by the machine
+
+    // Lattice
+    uint64_t numCellsX;         // including the ghost layers
+    uint64_t numCellsY;
+    uint32_t numDir;
+    uint32_t valueSize;         // bytes per f_q
+    char layout[32];            // Layout::name()
+    char storage[32];           // Storage::name()
+    uint32_t propagation;
+    uint32_t collision;
+    uint32_t twistSlot[32];     // Esoteric Twist: slot of every direction
+    uint64_t timeStep;          // time steps done
+    uint64_t geometryChecksum;  // of the obstacle cells
+
+    // Constants of the run (Parameters and Simulation)
+    real nx, ny;
+    real latticeVisc, latticeAcc, relaxRate;
+    uint64_t timeSteps;
+    real smagorinsky;
+    real accX, accY;
+
+    // Data following the header page
+    uint64_t dataBytes;
+    uint64_t dataChecksum;
+
+    // Of the header with this field set to 0
+    uint64_t headerChecksum;
+};
+
+static_assert(sizeof(CheckpointHeader) <= CHECKPOINT_HEADER_SIZE, "The checkpoint header must fit into its page");
+
+// 64 bit checksum of n bytes (4 interleaved multiply-xorshift lanes), not cryptographic
+uint64_t checksum64(const void*, const size_t&, const uint64_t& seed = 0);
+
+// Header with magic, version and byte order set, everything else 0
+CheckpointHeader checkpointHeader();
+
+// Writes header and the bytes of data to path. Fills in the sizes and checksums of header.
+// The file replaces path by a rename once it is on the disk, the directory is synced after.
+void writeCheckpointFile(const std::string& path, CheckpointHeader& header, const void* data, const size_t& bytes);
+
+// Read only mapping of a checkpoint file. The constructor checks magic, version, byte order,
+// the header checksum and the file size.
+class CheckpointReader{
+
+private:
+    std::string path;
+    int fd;
+    size_t fileSize;
+    const char* map;
+
+public:
+    explicit CheckpointReader(const std::string&);
+    ~CheckpointReader();
+
+    CheckpointReader(const CheckpointReader&) = delete;
+    CheckpointReader& operator=(const CheckpointReader&) = delete;
+
+    const CheckpointHeader& header() const { return *reinterpret_cast<const CheckpointHeader*>(map); }
+
+    // Checks the checksum of the data and copies it to data (bytes must be the size of the
+    // header), data is left as it is if the check fails
+    void read(void* data, const size_t& bytes) const;
+};
+
+#endif
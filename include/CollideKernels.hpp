@@ -0,0 +1,79 @@
+#ifndef COLLIDEKERNELS_HPP
+#define COLLIDEKERNELS_HPP
+
+#include "Type.hpp"
+#include "Collision.hpp"
+#include <cstddef>
+
+// Collides n consecutive cells with the operator Op of Collision.hpp.
+// in[q] points to the first (already streamed) f_q of the row, out[q] to where the first
+// post collision f_q is stored. All rows have unit stride, i.e. the lattice is stored as SoA
+// (or the cells are gathered into such rows).
+// in and out may point to the same memory.
+// The f_q's are stored as T (double or float) and computed in real. If shift is given, the
+// stored values are the deviations f_q - shift[q] (see ShiftedStorage in Storage.hpp).
+// If force is given the cells are accelerated with the Guo forcing (see Collision.hpp), the
+// fields of force start at the first cell of the row.
+template<typename T>
+using CollideKernel = void (*)(const T* const* in, T* const* out, const size_t& n, const CollisionRates& rates, const real* shift,
+                               const BodyForce* force);
+
+// Textbook BGK, the reference the kernels are verified against
+void collideRowReference(const double* const* in, double* const* out, const size_t& n, const CollisionRates& rates, const real* shift,
+                         const BodyForce* force);
+void collideRowReference(const float* const* in, float* const* out, const size_t& n, const CollisionRates& rates, const real* shift,
+                         const BodyForce* force);
+
+// One cell at a time
+template<typename Op, typename T>
+void collideRowScalar(const T* const* in, T* const* out, const size_t& n, const CollisionRates& rates, const real* shift,
+                      const BodyForce* force);
+
+// Explicitly vectorised versions (2, 4 and 8 cells at a time). They fall back to the
+// scalar version if the compiler could not build them for the instruction set.
+template<typename Op, typename T>
+void collideRowSSE2(const T* const* in, T* const* out, const size_t& n, const CollisionRates& rates, const real* shift,
+                    const BodyForce* force);
+template<typename Op, typename T>
+void collideRowAVX2(const T* const* in, T* const* out, const size_t& n, const CollisionRates& rates, const real* shift,
+                    const BodyForce* force);
+template<typename Op, typename T>
+void collideRowAVX512(const T* const* in, T* const* out, const size_t& n, const CollisionRates& rates, const real* shift,
+                      const BodyForce* force);
+
+// Instantiates a kernel for all operators (with and without LES) and storage types
+#define LBM_INSTANTIATE_COLLIDE_KERNEL_OP(kernel, Op) \
+    template void kernel<Op, double>(const double* const*, double* const*, const size_t&, const CollisionRates&, const real*, const BodyForce*); \
+    template void kernel<Op, float>(const float* const*, float* const*, const size_t&, const CollisionRates&, const real*, const BodyForce*);
+
+#define LBM_INSTANTIATE_COLLIDE_KERNEL(kernel) \
+    LBM_INSTANTIATE_COLLIDE_KERNEL_OP(kernel, BGK) \
+    LBM_INSTANTIATE_COLLIDE_KERNEL_OP(kernel, TRT) \
+    LBM_INSTANTIATE_COLLIDE_KERNEL_OP(kernel, MRT) \
+    LBM_INSTANTIATE_COLLIDE_KERNEL_OP(kernel, Regularized) \
+    LBM_INSTANTIATE_COLLIDE_KERNEL_OP(kernel, Cumulant) \
+    LBM_INSTANTIATE_COLLIDE_KERNEL_OP(kernel, Smagorinsky<BGK>) \
+    LBM_INSTANTIATE_COLLIDE_KERNEL_OP(kernel, Smagorinsky<TRT>) \
+    LBM_INSTANTIATE_COLLIDE_KERNEL_OP(kernel, Smagorinsky<MRT>) \
+    LBM_INSTANTIATE_COLLIDE_KERNEL_OP(kernel, Smagorinsky<Regularized>) \
+    LBM_INSTANTIATE_COLLIDE_KERNEL_OP(kernel, Smagorinsky<Cumulant>)
+
+template<typename T>
+struct CollideKernelInfo {
+    const char* name;
+    CollideKernel<T> kernel;
+};
+
+// Picks the widest kernel of the collision model supported by the CPU (checked via CPUID),
+// with the Smagorinsky model if les is set.
+// The choice can be overridden with the environment variable LBM_KERNEL=scalar|sse2|avx2|avx512.
+// The selected kernel is verified before it is returned, BGK against the reference, the
+// other operators against their scalar version.
+template<typename T>
+CollideKernelInfo<T> selectCollideKernel(const CollisionModel& model = bgk, const bool& les = false);
+
+// Returns the max. deviation of kernel from reference on random rows
+template<typename T>
+real verifyCollideKernel(CollideKernel<T> kernel, CollideKernel<T> reference, const CollisionRates& rates);
+
+#endif
@@ -0,0 +1,412 @@
+#ifndef COLLIDEROW_HPP
+#define COLLIDEROW_HPP
+
+#include "Simd.hpp"
+#include "Collision.hpp"
+
+// Collision of a row of cells written on top of the wrappers in Simd.hpp, for every operator
+// of Collision.hpp. Included by the per instruction set kernel files (and by CollideKernels.cpp
+// for the scalar version) only, see CollideKernels.hpp.
+// The moments and operators are written out for the directions of D2Q9.
+static_assert(Stencil::dim == 2 && Stencil::Q == 9, "The collision operators need the D2Q9 stencil");
+
+namespace {
+
+// Relaxation rates broadcast to all lanes
+template<typename V>
+struct Rates {
+    V omega, omegaOdd, omegaBulk, omegaEps;
+
+    // Smagorinsky<Op> only: tau_0 = 1/omega, the magic parameter and 18 sqrt(2) C_s^2
+    V tau, magic, eddy;
+
+    explicit Rates(const CollisionRates& r)
+        : omega(r.omega), omegaOdd(r.omegaOdd), omegaBulk(r.omegaBulk), omegaEps(r.omegaEps),
+          tau(1.0 / r.omega), magic(r.magic), eddy(18.0 * std::sqrt(2.0) * r.smagorinsky * r.smagorinsky) {}
+};
+
+// f_q of V::width cells, stored as T, optionally as deviation from shift
+template<typename V, bool Shifted, typename T>
+LBM_ALWAYS_INLINE V loadF(const T* p, const real* shift, const size_t& q)
+{
+    return Shifted ? V::load(p) + V(shift[q]) : V::load(p);
+}
+
+template<typename V, bool Shifted, typename T>
+LBM_ALWAYS_INLINE void storeF(const V& f, T* p, const real* shift, const size_t& q)
+{
+    if(Shifted)
+        (f - V(shift[q])).store(p);
+    else
+        f.store(p);
+}
+
+// Density and velocity of the cells
+template<typename V>
+LBM_ALWAYS_INLINE void moments(const V* f, V& rho, V& ux, V& uy)
+{
+    rho = f[C] + f[N] + f[S] + f[W] + f[E] + f[NE] + f[NW] + f[SW] + f[SE];
+    const V rhoInv = V(1.0) / rho;
+    ux = ((f[E] + f[NE] + f[SE]) - (f[W] + f[NW] + f[SW])) * rhoInv;
+    uy = ((f[N] + f[NE] + f[NW]) - (f[S] + f[SW] + f[SE])) * rhoInv;
+}
+
+// Second order equilibrium, feq_q = w_q rho (1 - 1.5 u^2 + 3 cu + 4.5 cu^2)
+template<typename V>
+LBM_ALWAYS_INLINE void equilibrium(const V& rho, const V& ux, const V& uy, V* feq)
+{
+    const V base = V(1.0) - V(1.5) * fmadd(ux, ux, uy * uy);
+    const V wr0 = V(4.0 / 9.0) * rho;
+    const V wr1 = V(1.0 / 9.0) * rho;
+    const V wr2 = V(1.0 / 36.0) * rho;
+    const V three(3.0), fourHalf(4.5);
+
+#define LBM_FEQ(q, wr, cu) \
+    { const V cu_ = (cu); feq[q] = wr * fmadd(cu_, fmadd(fourHalf, cu_, three), base); }
+
+    feq[C] = wr0 * base;
+    LBM_FEQ(N,  wr1, uy)
+    LBM_FEQ(S,  wr1, V(0.0) - uy)
+    LBM_FEQ(W,  wr1, V(0.0) - ux)
+    LBM_FEQ(E,  wr1, ux)
+    LBM_FEQ(NE, wr2, ux + uy)
+    LBM_FEQ(NW, wr2, uy - ux)
+    LBM_FEQ(SW, wr2, V(0.0) - ux - uy)
+    LBM_FEQ(SE, wr2, ux - uy)
+
+#undef LBM_FEQ
+}
+
+// The operators work in place on the f_q's of V::width cells, with their density and velocity
+template<typename Op>
+struct Collide;
+
+template<>
+struct Collide<BGK> {
+
+    template<typename V>
+    static LBM_ALWAYS_INLINE void apply(V* f, const V& rho, const V& ux, const V& uy, const Rates<V>& r)
+    {
+        V feq[Stencil::Q];
+        equilibrium(rho, ux, uy, feq);
+
+        // f_q <- (1 - omega) f_q + omega * feq_q
+        const V oneMinusOmega = V(1.0) - r.omega;
+        for(size_t q=0; q< Stencil::Q; ++q)
+            f[q] = fmadd(oneMinusOmega, f[q], r.omega * feq[q]);
+    }
+};
+
+template<>
+struct Collide<TRT> {
+
+    // Relaxes the even and odd parts of the pair q, opposite(q)
+    template<typename V>
+    static LBM_ALWAYS_INLINE void pair(V* f, const V* feq, const size_t& q, const size_t& p, const V& omegaEven, const V& omegaOdd)
+    {
+        const V half(0.5);
+        const V even = omegaEven * half * ((f[q] + f[p]) - (feq[q] + feq[p]));
+        const V odd = omegaOdd * half * ((f[q] - f[p]) - (feq[q] - feq[p]));
+
+        f[q] = f[q] - (even + odd);
+        f[p] = f[p] - (even - odd);
+    }
+
+    template<typename V>
+    static LBM_ALWAYS_INLINE void apply(V* f, const V& rho, const V& ux, const V& uy, const Rates<V>& r)
+    {
+        V feq[Stencil::Q];
+        equilibrium(rho, ux, uy, feq);
+
+        f[C] = f[C] - r.omega * (f[C] - feq[C]);
+        pair(f, feq, N, S, r.omega, r.omegaOdd);
+        pair(f, feq, E, W, r.omega, r.omegaOdd);
+        pair(f, feq, NE, SW, r.omega, r.omegaOdd);
+        pair(f, feq, NW, SE, r.omega, r.omegaOdd);
+    }
+};
+
+template<>
+struct Collide<MRT> {
+
+    // f <- f - M^-1 S M (f - feq). The rows of M are orthogonal, M^-1 = M^T diag(1 / |row|^2).
+    // The conserved moments (density and momentum) of f - feq vanish and are left out.
+    template<typename V>
+    static LBM_ALWAYS_INLINE void apply(V* f, const V& rho, const V& ux, const V& uy, const Rates<V>& r)
+    {
+        V n[Stencil::Q];
+        equilibrium(rho, ux, uy, n);
+        for(size_t q=0; q< Stencil::Q; ++q)
+            n[q] = f[q] - n[q];
+
+        const V axis = n[N] + n[S] + n[W] + n[E];
+        const V diag = n[NE] + n[NW] + n[SW] + n[SE];
+        const V two(2.0), four(4.0);
+
+        // Non equilibrium moments, each times its rate and divided by |row|^2
+        const V e   = r.omegaBulk * V(1.0 / 36.0) * (two * diag - axis - four * n[C]);
+        const V eps = r.omegaEps * V(1.0 / 36.0) * (four * n[C] - two * axis + diag);
+        const V qx  = r.omegaOdd * V(1.0 / 12.0) * ((n[NE] - n[NW] - n[SW] + n[SE]) - two * (n[E] - n[W]));
+        const V qy  = r.omegaOdd * V(1.0 / 12.0) * ((n[NE] + n[NW] - n[SW] - n[SE]) - two * (n[N] - n[S]));
+        const V pxx = r.omega * V(0.25) * ((n[E] + n[W]) - (n[N] + n[S]));
+        const V pxy = r.omega * V(0.25) * ((n[NE] + n[SW]) - (n[NW] + n[SE]));
+
+        // Back to the populations, column q of M
+        const V axisPart = V(0.0) - e - two * eps;
+        const V diagPart = two * e + eps;
+
+        f[C]  = f[C] - four * (eps - e);
+        f[N]  = f[N] - (axisPart - two * qy - pxx);
+        f[S]  = f[S] - (axisPart + two * qy - pxx);
+        f[E]  = f[E] - (axisPart - two * qx + pxx);
+        f[W]  = f[W] - (axisPart + two * qx + pxx);
+        f[NE] = f[NE] - (diagPart + qx + qy + pxy);
+        f[NW] = f[NW] - (diagPart - qx + qy - pxy);
+        f[SW] = f[SW] - (diagPart - qx - qy + pxy);
+        f[SE] = f[SE] - (diagPart + qx - qy - pxy);
+    }
+};
+
+template<>
+struct Collide<Regularized> {
+
+    // f_q <- feq_q + (1 - omega) w_q / (2 cs^4) Q_q : Pi_neq, with Q_q = c_q c_q - cs^2 I
+    template<typename V>
+    static LBM_ALWAYS_INLINE void apply(V* f, const V& rho, const V& ux, const V& uy, const Rates<V>& r)
+    {
+        V feq[Stencil::Q];
+        equilibrium(rho, ux, uy, feq);
+
+        // Non equilibrium stress
+        V n[Stencil::Q];
+        for(size_t q=0; q< Stencil::Q; ++q)
+            n[q] = f[q] - feq[q];
+
+        const V diag = n[NE] + n[NW] + n[SW] + n[SE];
+        const V pxx = n[E] + n[W] + diag;
+        const V pyy = n[N] + n[S] + diag;
+        const V pxy = (n[NE] + n[SW]) - (n[NW] + n[SE]);
+
+        const V oneMinusOmega = V(1.0) - r.omega;
+        const V third(1.0 / 3.0), sixth(1.0 / 6.0);
+        const V trace = V(1.0 / 12.0) * (pxx + pyy);
+        const V shear = V(0.25) * pxy;
+
+        f[C]  = fmadd(oneMinusOmega, V(-2.0 / 3.0) * (pxx + pyy), feq[C]);
+        f[E]  = fmadd(oneMinusOmega, third * pxx - sixth * pyy, feq[E]);
+        f[W]  = fmadd(oneMinusOmega, third * pxx - sixth * pyy, feq[W]);
+        f[N]  = fmadd(oneMinusOmega, third * pyy - sixth * pxx, feq[N]);
+        f[S]  = fmadd(oneMinusOmega, third * pyy - sixth * pxx, feq[S]);
+        f[NE] = fmadd(oneMinusOmega, trace + shear, feq[NE]);
+        f[SW] = fmadd(oneMinusOmega, trace + shear, feq[SW]);
+        f[NW] = fmadd(oneMinusOmega, trace - shear, feq[NW]);
+        f[SE] = fmadd(oneMinusOmega, trace - shear, feq[SE]);
+    }
+};
+
+template<>
+struct Collide<Cumulant> {
+
+    // Central moments of the three populations with c = -1, 0, 1 along one axis
+    // (the chimera transform of Geier et al.), and back
+    template<typename V>
+    static LBM_ALWAYS_INLINE void forward(V& fm, V& f0, V& fp, const V& u)
+    {
+        const V k0 = fm + f0 + fp;
+        const V k1 = (fp - fm) - u * k0;
+        const V k2 = (fp + fm) - V(2.0) * u * (fp - fm) + u * u * k0;
+        fm = k0; f0 = k1; fp = k2;
+    }
+
+    template<typename V>
+    static LBM_ALWAYS_INLINE void backward(V& k0, V& k1, V& k2, const V& u)
+    {
+        const V half(0.5);
+        const V fm = half * (k0 * (u * u - u) + k1 * (V(2.0) * u - V(1.0)) + k2);
+        const V f0 = k0 * (V(1.0) - u * u) - V(2.0) * u * k1 - k2;
+        const V fp = half * (k0 * (u * u + u) + k1 * (V(2.0) * u + V(1.0)) + k2);
+        k0 = fm; k1 = f0; k2 = fp;
+    }
+
+    template<typename V>
+    static LBM_ALWAYS_INLINE void apply(V* f, const V& rho, const V& ux, const V& uy, const Rates<V>& r)
+    {
+        // m[a][b]: populations with c = (a-1, b-1), turned into the central moments k_ab
+        V m[3][3] = {{f[SW], f[W], f[NW]},
+                     {f[S],  f[C], f[N]},
+                     {f[SE], f[E], f[NE]}};
+
+        for(size_t b=0; b< 3; ++b)
+            forward(m[0][b], m[1][b], m[2][b], ux);
+        for(size_t a=0; a< 3; ++a)
+            forward(m[a][0], m[a][1], m[a][2], uy);
+
+        // Second order: bulk (trace) and shear parts relax towards rho cs^2 I
+        const V sum = m[2][0] + m[0][2];
+        const V diff = m[2][0] - m[0][2];
+        const V sumPost = sum + r.omegaBulk * (V(2.0 / 3.0) * rho - sum);
+        const V diffPost = (V(1.0) - r.omega) * diff;
+
+        m[2][0] = V(0.5) * (sumPost + diffPost);
+        m[0][2] = V(0.5) * (sumPost - diffPost);
+        m[1][1] = (V(1.0) - r.omega) * m[1][1];
+
+        // Third and fourth order cumulants at their equilibrium 0. The third order central
+        // moments are the cumulants, the fourth order one is C_22 = k_22 - (k_20 k_02 + 2 k_11^2) / rho.
+        m[2][1] = V(0.0);
+        m[1][2] = V(0.0);
+        m[2][2] = (m[2][0] * m[0][2] + V(2.0) * m[1][1] * m[1][1]) / rho;
+
+        for(size_t a=0; a< 3; ++a)
+            backward(m[a][0], m[a][1], m[a][2], uy);
+        for(size_t b=0; b< 3; ++b)
+            backward(m[0][b], m[1][b], m[2][b], ux);
+
+        f[SW] = m[0][0]; f[W] = m[0][1]; f[NW] = m[0][2];
+        f[S]  = m[1][0]; f[C] = m[1][1]; f[N]  = m[1][2];
+        f[SE] = m[2][0]; f[E] = m[2][1]; f[NE] = m[2][2];
+    }
+};
+
+template<typename Op>
+struct Collide<Smagorinsky<Op> > {
+
+    // Relaxes with the rates of the local tau, see Collision.hpp
+    template<typename V>
+    static LBM_ALWAYS_INLINE void apply(V* f, const V& rho, const V& ux, const V& uy, const Rates<V>& r)
+    {
+        // Non equilibrium stress, second moments of f minus those of the equilibrium
+        const V third(1.0 / 3.0);
+        const V diag = f[NE] + f[NW] + f[SW] + f[SE];
+        const V pxx = f[E] + f[W] + diag - rho * fmadd(ux, ux, third);
+        const V pyy = f[N] + f[S] + diag - rho * fmadd(uy, uy, third);
+        const V pxy = (f[NE] + f[SW]) - (f[NW] + f[SE]) - rho * ux * uy;
+        const V norm = sqrt(fmadd(pxx, pxx, fmadd(pyy, pyy, V(2.0) * pxy * pxy)));
+
+        const V half(0.5), one(1.0);
+        const V tau = half * (r.tau + sqrt(fmadd(r.tau, r.tau, r.eddy * norm / rho)));
+
+        Rates<V> local = r;
+        local.omega = one / tau;
+        local.omegaOdd = one / (r.magic / (tau - half) + half);
+
+        Collide<Op>::apply(f, rho, ux, uy, local);
+    }
+};
+
+// Body force of a row: none, constant or constant plus per cell field
+enum Forcing { unforced, constantForce, forceField };
+
+// Half of the Guo source term S_q of the cells with acceleration (ax, ay), see Collision.hpp.
+// The velocity is updated to u = (j + F/2) / rho, that of f + S/2.
+template<typename V>
+LBM_ALWAYS_INLINE void halfGuoSource(const V& rho, V& ux, V& uy, const V& ax, const V& ay, V* halfS)
+{
+    const V half(0.5);
+    ux = fmadd(half, ax, ux);
+    uy = fmadd(half, ay, uy);
+
+    // S_q = 3 w_q (c_q.F (1 + 3 c_q.u) - u.F), F = rho a
+    const V fx = rho * ax, fy = rho * ay;
+    const V uF = fmadd(ux, fx, uy * fy);
+    const V w0 = V(1.5 * 4.0 / 9.0), w1 = V(1.5 / 9.0), w2 = V(1.5 / 36.0);
+    const V one(1.0), three(3.0);
+
+#define LBM_GUO(q, w, cu, cF) \
+    halfS[q] = w * (fmadd((cF), fmadd(three, (cu), one), V(0.0) - uF));
+
+    halfS[C] = V(0.0) - w0 * uF;
+    LBM_GUO(N,  w1, uy, fy)
+    LBM_GUO(S,  w1, V(0.0) - uy, V(0.0) - fy)
+    LBM_GUO(W,  w1, V(0.0) - ux, V(0.0) - fx)
+    LBM_GUO(E,  w1, ux, fx)
+    LBM_GUO(NE, w2, ux + uy, fx + fy)
+    LBM_GUO(NW, w2, uy - ux, fy - fx)
+    LBM_GUO(SW, w2, V(0.0) - ux - uy, V(0.0) - fx - fy)
+    LBM_GUO(SE, w2, ux - uy, fx - fy)
+
+#undef LBM_GUO
+}
+
+// Collides V::width consecutive cells starting at offset i
+template<typename V, typename Op, bool Shifted, Forcing Force, typename T>
+LBM_ALWAYS_INLINE void collideCells(const T* const* in, T* const* out, const size_t& i, const Rates<V>& rates, const real* shift,
+                         const BodyForce* force)
+{
+    // Load all populations first, in and out may point to the same memory
+    V f[Stencil::Q];
+    for(size_t q=0; q< Stencil::Q; ++q)
+        f[q] = loadF<V, Shifted>(in[q] + i, shift, q);
+
+    V rho, ux, uy;
+    moments(f, rho, ux, uy);
+
+    if(Force == unforced) {
+        Collide<Op>::apply(f, rho, ux, uy, rates);
+    }
+    else {
+        // Collision of f + S/2, then the other half of S
+        V ax(force->x), ay(force->y);
+        if(Force == forceField) {
+            ax = ax + V::load(force->fieldX + i);
+            ay = ay + V::load(force->fieldY + i);
+        }
+
+        V halfS[Stencil::Q];
+        halfGuoSource(rho, ux, uy, ax, ay, halfS);
+
+        for(size_t q=0; q< Stencil::Q; ++q)
+            f[q] = f[q] + halfS[q];
+
+        Collide<Op>::apply(f, rho, ux, uy, rates);
+
+        for(size_t q=0; q< Stencil::Q; ++q)
+            f[q] = f[q] + halfS[q];
+    }
+
+    for(size_t q=0; q< Stencil::Q; ++q)
+        storeF<V, Shifted>(f[q], out[q] + i, shift, q);
+}
+
+// Collides n cells, V::width at a time and the remainder one by one
+template<typename V, typename Op, bool Shifted, Forcing Force, typename T>
+void collideRowT(const T* const* in, T* const* out, const size_t& n, const CollisionRates& rates, const real* shift,
+                        const BodyForce* force)
+{
+    const Rates<V> ratesV(rates);
+    const Rates<VecScalar> ratesS(rates);
+
+    size_t i = 0;
+    for(; i + V::width <= n; i += V::width)
+        collideCells<V, Op, Shifted, Force>(in, out, i, ratesV, shift, force);
+
+    for(; i < n; ++i)
+        collideCells<VecScalar, Op, Shifted, Force>(in, out, i, ratesS, shift, force);
+}
+
+template<typename V, typename Op, bool Shifted, typename T>
+void collideRowT(const T* const* in, T* const* out, const size_t& n, const CollisionRates& rates, const real* shift,
+                        const BodyForce* force)
+{
+    if(!force)
+        collideRowT<V, Op, Shifted, unforced>(in, out, n, rates, shift, force);
+    else if(force->fieldX)
+        collideRowT<V, Op, Shifted, forceField>(in, out, n, rates, shift, force);
+    else
+        collideRowT<V, Op, Shifted, constantForce>(in, out, n, rates, shift, force);
+}
+
+// The kernel interface of CollideKernels.hpp, shift == 0 for plain storage, force == 0 without
+template<typename V, typename Op, typename T>
+void collideRow(const T* const* in, T* const* out, const size_t& n, const CollisionRates& rates, const real* shift,
+                       const BodyForce* force)
+{
+    if(shift)
+        collideRowT<V, Op, true>(in, out, n, rates, shift, force);
+    else
+        collideRowT<V, Op, false>(in, out, n, rates, shift, force);
+}
+
+} // namespace
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef COLLISION_HPP
+#define COLLISION_HPP
+
+#include "Type.hpp"
+#include "Stencil.hpp"
+
+// Collision operators of the fused stream/collide kernels. The operators are policies of the
+// row kernels (see CollideRow.hpp), every one is built for every instruction set, the one to
+// use is picked at runtime together with the instruction set (see CollideKernels.hpp).
+//
+//  BGK        : single relaxation time, all moments relax with omega
+//  TRT        : two relaxation times, the even part of f relaxes with omega (viscosity), the
+//               odd part with omegaOdd, chosen by the magic parameter
+//               Lambda = (1/omega - 1/2)(1/omegaOdd - 1/2). Lambda = 3/16 puts the bounce back
+//               wall exactly halfway between the cells, independent of the viscosity.
+//  MRT        : multiple relaxation times on the moments of Lallemand & Luo (2000): the stress
+//               relaxes with omega, the energy e with omegaBulk, its square with omegaEps and the
+//               energy fluxes with omegaOdd (same wall location as TRT)
+//  Regularized: the non equilibrium part is projected onto the stress before it relaxes
+//               with omega (Latt & Chopard 2006), i.e. the ghost modes are reset every step
+//  Cumulant   : relaxation of the cumulants (Geier et al. 2015), shear with omega, bulk with
+//               omegaBulk, the third and fourth order ones are set to their equilibrium
+//
+// All operators give the viscosity nu = (1/omega - 1/2) / 3. The additional rates damp the
+// other modes, which keeps the low viscosity (omega close to 2) runs stable on coarse grids.
+//
+// Smagorinsky<Op> adds the Smagorinsky subgrid model (LES) to any of them: every cell relaxes
+// with its own omega, from the viscosity plus the eddy viscosity nu_t = (C_s Delta)^2 |S|.
+// The strain rate S follows from the local non equilibrium stress Pi, so no neighbours are
+// needed (Hou et al. 1996):
+//     tau = (tau_0 + sqrt(tau_0^2 + 18 sqrt(2) C_s^2 |Pi| / rho)) / 2,   tau_0 = 1 / omega
+// omegaOdd follows tau with the same magic parameter, the bulk rates stay.
+//
+// A body force is applied with the scheme of Guo et al. (2002), fused into the collision:
+// with the source S_q = w_q (3 (c_q - u) + 9 (c_q . u) c_q) . F, F = rho a, every operator
+// collides f + S/2 and adds S/2 again. The velocity is then u = (j + F/2) / rho, and each
+// moment of S is relaxed with 1 - s/2 of its rate s, i.e. for BGK
+//     f_q <- f_q - omega (f_q - feq_q(u)) + (1 - omega/2) S_q
+
+struct BGK         { static const char* name() { return "BGK"; } };
+struct TRT         { static const char* name() { return "TRT"; } };
+struct MRT         { static const char* name() { return "MRT"; } };
+struct Regularized { static const char* name() { return "regularized"; } };
+struct Cumulant    { static const char* name() { return "cumulant"; } };
+
+template<typename Op>
+struct Smagorinsky { static const char* name() { return Op::name(); } };
+
+// Magic parameter of TRT (and MRT), see above
+#define TRT_MAGIC (3.0 / 16.0)
+
+// Relaxation rates of a collision
+struct CollisionRates {
+    real omega;       // Shear viscosity, relaxRate
+    real omegaOdd;    // TRT: odd part, MRT: energy fluxes
+    real omegaBulk;   // MRT: energy, cumulant: bulk viscosity
+    real omegaEps;    // MRT: energy square
+    real magic;       // (1/omega - 1/2)(1/omegaOdd - 1/2)
+    real smagorinsky; // Smagorinsky constant C_s, only used by Smagorinsky<Op>
+};
+
+// Body acceleration a in lattice units, constant (x, y) plus the per cell values of fieldX,
+// fieldY if given (rows of cells like the f_q's, see CollideKernels.hpp)
+struct BodyForce {
+    real x, y;
+    const real* fieldX;
+    const real* fieldY;
+};
+
+// Rates for the given shear rate omega, the others are derived from the magic parameter or
+// set to 1 (relaxation straight to the equilibrium)
+CollisionRates collisionRates(const real& omega, const real& smagorinsky = 0.0, const real& magic = TRT_MAGIC);
+
+// Name of the collision model
+const char* collisionName(const CollisionModel&);
+
+#endif
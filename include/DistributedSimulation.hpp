@@ -0,0 +1,148 @@
+#ifndef DISTRIBUTEDSIMULATION_HPP
+#define DISTRIBUTEDSIMULATION_HPP
+
+#include "Type.hpp"
+#include "Storage.hpp"
+#include "FlagField.hpp"
+#include "FieldWriter.hpp"
+#include "LatticeAllocator.hpp"
+#include "CollideKernels.hpp"
+#include <mpi.h>
+#include <vector>
+#include <cstdint>
+
+// Two lattice pull scheme on a 2D block decomposition of the domain, one block per MPI rank.
+// Every block keeps one ghost layer like Simulation, its f_q's are stored in SoA order
+// (f_q of cell c at q*numCells + c), so the rows are collided by the SIMD kernels right where
+// they are.
+//
+// The ghost layer of a block holds the f_q's its cells pull from the neighbouring blocks. Only
+// the f_q's crossing a face are exchanged: 3 per cell along an edge (e.g. E, NE, SE to the east
+// neighbour), 1 for a corner. The periodic BC's in x are part of this exchange (the blocks at
+// the ends of a row of blocks are neighbours, with a single block in x a rank exchanges with
+// itself), the walls in the north and south and the obstacles use the halfway bounce back.
+//
+// The exchange overlaps the interior of the block:
+//   1. post the receives and the sends of the edge f_q's (nonblocking)
+//   2. bounce back and stream/collide the interior cells, which pull nothing from the ghost layer
+//   3. wait for the receives, unpack them into the ghost layer, bounce back from ghost cells
+//   4. stream/collide the cells along the edges
+//
+// Every rank is given the geometry of the whole domain and keeps its block of it. The
+// acceleration is constant (no per cell field).
+template<typename Storage>
+class DistributedSimulation{
+
+    typedef typename Storage::value_type value_type;
+
+private:
+    // Cartesian communicator of the blocks, periodic in x
+    MPI_Comm comm;
+    int rank_;
+    int numRanks;
+    int blocks[2];     // no. of blocks in x and y
+    int coords[2];     // of this block
+
+    size_t globalX;    // non ghost cells of the whole domain
+    size_t globalY;
+    size_t offsetX;    // the block's first non ghost cell is cell (offsetX + 1, offsetY + 1) of the domain
+    size_t offsetY;
+
+    size_t numCellsX;  // This includes ghost cells
+    size_t numCellsY;
+    size_t numCells;
+    size_t globalFluid;
+
+    std::vector<value_type, LatticeAllocator<value_type> > src;
+    std::vector<value_type, LatticeAllocator<value_type> > dest;
+
+    // Obstacles of the block including the ghost layer
+    std::vector<uint8_t> obstacle;
+
+    // Halfway bounce back: f_q of fluid cell c is pulled from the solid cell c - c_q, which gets
+    // the cell's f_opposite(q). Links from solid cells in the ghost layer are applied after
+    // the halos are unpacked.
+    struct Link {
+        uint32_t cell;
+        uint32_t q;
+    };
+    std::vector<Link> interiorLinks;
+    std::vector<Link> ghostLinks;
+
+    // Exchange of the f_q's moving in direction d of the 8 neighbour directions (dx, dy): they
+    // are sent to the neighbour at (dx, dy) and received from the one at (-dx, -dy).
+    // MPI_PROC_NULL beyond the walls. The indices are positions in src, in the same order on
+    // both sides.
+    struct Halo {
+        int sendRank;
+        int recvRank;
+        std::vector<uint32_t> sendIndex;
+        std::vector<uint32_t> recvIndex;
+        std::vector<value_type> sendBuffer;
+        std::vector<value_type> recvBuffer;
+    };
+    Halo halos[8];
+    MPI_Request requests[16];
+
+    // Vectorised collision of the rows, selected at startup
+    CollideKernelInfo<value_type> collideKernel;
+    real smagorinsky;
+    real accX, accY;
+
+    size_t timeStep;
+
+    size_t cell(const size_t& i, const size_t& j) const { return j*numCellsX + i; }
+
+    // Send and receive lists of the neighbour blocks
+    void buildHalos();
+
+    // Starts the exchange of the ghost layer (step 1), finishes it (step 3)
+    void startExchange();
+    void finishExchange();
+
+    void bounceBack(const std::vector<Link>&);
+
+    // Stream and collide of the fluid cells in rows [jBegin, jEnd), columns [iBegin, iEnd)
+    void sweep(const size_t&, const size_t&, const size_t&, const size_t&);
+
+public:
+    // flags is the geometry of the whole domain including its ghost layers, the same on every
+    // rank. The domain is split into blocksX x blocksY blocks. With one of them 0 it is the no.
+    // of ranks divided by the other one, with both 0 the split giving the shortest halos is
+    // chosen. Throws std::invalid_argument if the blocks don't match the ranks or the cells, or
+    // a block is too large for the 32 bit indices. Collective over comm.
+    DistributedSimulation(const FlagField&, MPI_Comm = MPI_COMM_WORLD, const CollisionModel& = bgk, const real& = 0.0,
+                          const int& blocksX = 0, const int& blocksY = 0);
+    ~DistributedSimulation();
+
+    DistributedSimulation(const DistributedSimulation&) = delete;
+    DistributedSimulation& operator=(const DistributedSimulation&) = delete;
+
+    int rank() const { return rank_; }
+    int blocksX() const { return blocks[0]; }
+    int blocksY() const { return blocks[1]; }
+
+    void setAcceleration(const real&, const real&);
+
+    // One time step of all blocks, collective
+    void stream_Collide();
+
+    // Performs the given no. of time steps, without reporting
+    void advance(const size_t&);
+
+    // Perform all simulation steps of LBM, rank 0 reports the performance of all ranks
+    void runSimulation();
+
+    // Memory traffic of one cell update in bytes, without the halos
+    double bytesPerCellUpdate() const;
+
+    // Density and velocity of the whole domain, as Simulation::macroscopicFields(), gathered on
+    // rank 0 of the Cartesian communicator, i.e. the rank with rank() == 0, which need not be
+    // rank 0 of the communicator given to the constructor. The snapshot of the other ranks is
+    // left empty. Collective.
+    void macroscopicFields(FieldSnapshot&);
+
+    const char* collideKernelName() const { return collideKernel.name; }
+};
+
+#endif
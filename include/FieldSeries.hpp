@@ -0,0 +1,144 @@
+#ifndef FIELDSERIES_HPP
+#define FIELDSERIES_HPP
+
+#include "Type.hpp"
+#include "FieldWriter.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+
+// Compressed time series of the macroscopic fields in one append-only file, for long runs where
+// a full snapshot per output would be far too much data.
+//
+// Every field (density, u_x, u_y) is quantized to a multiple of the largest power of two up to
+// twice its error bound, so a value read back is within the bound of the snapshot's value. A
+// frame stores the differences of the quantized values to the previous frame, a key frame
+// every keyframeInterval frames the values themselves. The differences of a slowly changing
+// flow are small integers: they are zigzag coded and split into byte planes (all lowest bytes,
+// then all second bytes, ...), which leaves long runs of zeros for the deflate of lodepng.
+// The quantization is the only loss, the differences are exact, so the error does not grow
+// along the series.
+//
+//  SeriesHeader            sizes, error bounds, checksums
+//  mask                    zlib of the fluid flags, maskBytes
+//  frame, frame, ...       SeriesFrameHeader followed by the zlib of the planes, dataBytes
+//
+// Frames are only appended. A frame cut off by a crash is dropped when the file is read or
+// appended to, and so are the frames of the time steps a continued run writes again (a new
+// run from time step 0, or a restart from a checkpoint older than the last frames), so the
+// time steps of the frames always increase. The vorticity is not stored, SeriesReader computes it.
+//
+// Errors (the file can't be written, is corrupt or doesn't fit the snapshots, a value is NaN
+// or too large for its error bound) are reported as std::runtime_error.
+
+#define SERIES_VERSION 2
+
+struct SeriesHeader {
+    char magic[8];              // "LBMSERS"
+    uint32_t version;           // SERIES_VERSION
+    uint32_t byteOrder;         // 0x01020304 as written by the machine
+
+    uint64_t sizeX;             // cells of a frame
+    uint64_t sizeY;
+    uint64_t spacing;           // lattice cells per cell, see FieldSnapshot
+
+    real densityError;
+    real velocityError;
+    uint64_t keyframeInterval;
+
+    // Fluid flags following the header
+    uint64_t maskBytes;         // compressed
+    uint64_t maskChecksum;      // of the flags
+
+    // Of the header with this field set to 0
+    uint64_t headerChecksum;
+};
+
+struct SeriesFrameHeader {
+    char magic[4];              // "FRM"
+    uint32_t keyframe;          // 1: the quantized values, 0: differences to the previous frame
+    uint64_t timeStep;
+
+    // Compressed planes following the header
+    uint64_t dataBytes;
+    uint64_t dataChecksum;
+
+    uint64_t headerChecksum;
+};
+
+// Appends snapshots to a series file
+class SeriesWriter{
+
+private:
+    std::string path;
+    SeriesHeader header;
+    std::ofstream file;
+
+    std::vector<int32_t> previous;  // quantized values of the last frame
+    size_t sinceKeyframe;           // frames since the last key frame, keyframeInterval forces one
+
+    // Buffers of one frame
+    std::vector<int32_t> values;
+    std::vector<unsigned char> planes;
+    std::vector<unsigned char> compressed;
+
+    size_t numFrames;               // appended by this writer
+    size_t rawBytes;                // of the snapshots as floats
+    size_t storedBytes;
+
+    // The fields of the snapshot into values, throws for a NaN or a value the error bound
+    // can't represent
+    void quantizeFields(const FieldSnapshot&);
+
+public:
+    // Creates path for snapshots like the given one, or appends to path if it is a series of
+    // the same size, spacing, geometry and error bounds. The frames of path from the time step
+    // firstStep on are dropped, the writer's frames take their place.
+    SeriesWriter(const std::string&, const FieldSnapshot&, const SeriesSettings&, const size_t& firstStep);
+    ~SeriesWriter();
+
+    SeriesWriter(const SeriesWriter&) = delete;
+    SeriesWriter& operator=(const SeriesWriter&) = delete;
+
+    void append(const FieldSnapshot&);
+};
+
+// Reads a series file frame by frame
+class SeriesReader{
+
+private:
+    std::string path;
+    std::ifstream file;
+    SeriesHeader header_;
+    std::vector<uint8_t> fluid;
+
+    std::vector<int32_t> previous;
+    std::vector<unsigned char> planes;
+    std::vector<unsigned char> compressed;
+
+    size_t numFrames;               // read or skipped so far
+    uint64_t end;                   // file offset after the last complete frame
+
+    // Header of the next frame, false at the end of the file or if it is cut off
+    bool nextHeader(SeriesFrameHeader&);
+
+public:
+    // Reads and checks the header and the fluid flags
+    explicit SeriesReader(const std::string&);
+
+    const SeriesHeader& header() const { return header_; }
+
+    // The next frame with the vorticity computed, false at the end of the file
+    bool next(FieldSnapshot&);
+
+    // Steps over the next frame without decoding it if its time step is before the given one,
+    // false at the end of the file or at a later frame
+    bool skip(const uint64_t& before = UINT64_MAX);
+
+    size_t framesRead() const { return numFrames; }
+    uint64_t endOfFrames() const { return end; }
+};
+
+#endif
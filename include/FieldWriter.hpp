@@ -0,0 +1,141 @@
+#ifndef FIELDWRITER_HPP
+#define FIELDWRITER_HPP
+
+#include "Type.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <memory>       // std::unique_ptr
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Macroscopic fields of the non ghost cells after a time step, cell (i,j) at j*sizeX + i
+// with i, j counted from the first non ghost cell. Obstacle cells are 0.
+// Filled by Simulation::macroscopicFields(), the vorticity is computed by the writer.
+// A downsampled snapshot holds the means of the fluid cells of spacing x spacing blocks
+// of the lattice, a block with any fluid cell is fluid.
+struct FieldSnapshot {
+    size_t sizeX;
+    size_t sizeY;
+    size_t spacing;     // lattice cells per snapshot cell in x and y
+    size_t timeStep;
+
+    std::vector<float> density;
+    std::vector<float> velocity;     // 3 components per cell, z = 0
+    std::vector<float> vorticity;    // du_y/dx - du_x/dy
+    std::vector<uint8_t> fluid;      // 1 for fluid cells, 0 for obstacles
+
+    void resize(const size_t&, const size_t&, const size_t& spacing = 1);
+
+    // Central differences of the velocity, one sided next to obstacles and walls, periodic in x
+    void computeVorticity();
+};
+
+// File formats of the writer, can be combined
+typedef enum { vtkImageData = 1, xdmfRaw = 2, pngImage = 4, compressedSeries = 8 } FieldFormat;
+
+// Field shown by pngImage
+typedef enum { imageSpeed, imageVorticity } ImageField;
+
+// Pixels per side of the monitoring images, larger lattices are downsampled to this size
+#define MAX_IMAGE_SIZE 512
+
+// Error bounds (lattice units) of compressedSeries and the distance of its key frames
+struct SeriesSettings {
+    real densityError;
+    real velocityError;
+    size_t keyframeInterval;
+
+    SeriesSettings(const real& density = 1e-6, const real& velocity = 1e-6, const size_t& keyframes = 32)
+        : densityError(density), velocityError(velocity), keyframeInterval(keyframes) {}
+};
+
+class SeriesWriter;
+
+// Writes snapshots of the macroscopic fields from a background thread, so the time loop only
+// pays for computing the fields, not for the disk.
+//  vtkImageData: <prefix>_<step>.vti, VTK XML image data with the fields appended as raw binary
+//  xdmfRaw     : <prefix>_<step>.raw with the raw fields (native byte order) and the XDMF
+//                description <prefix>_<step>.xmf
+// Both are read by ParaView and VisIt. The fields are stored as 32 bit floats.
+//  pngImage    : <prefix>_<step>.png, grey scale image of the speed |u| or the vorticity for
+//                monitoring a run, one pixel per snapshot cell, encoded with the fast
+//                settings of GrayScaleImage::save(). Obstacles are black, the speed goes from
+//                black (0) to white (range), the vorticity from black (-range) over grey (0) to
+//                white (range). With range 0 every image is scaled to its own maximum.
+//  compressedSeries: all snapshots in <prefix>.lbms, quantized to the error bounds of the
+//                SeriesSettings, delta coded and compressed (see FieldSeries.hpp). A run
+//                appends to the file, its frames replace those of the same and later time
+//                steps (see continueAfter()).
+//
+// The snapshots are double buffered: the time loop fills one buffer while the other is being
+// written. acquire() only waits if the previous snapshot of the buffer is not written yet.
+//
+//     sim.macroscopicFields(writer.acquire());
+//     writer.submit();
+//
+// Write errors are logged. The destructor writes the pending snapshots.
+class FieldWriter{
+
+private:
+    static const size_t numBuffers = 2;
+
+    std::string prefix;
+    unsigned formats;
+    ImageField imageField;
+    real imageRange;
+    SeriesSettings seriesSettings;
+    std::unique_ptr<SeriesWriter> series;   // opened with the first snapshot
+    size_t seriesFirstStep;                 // its frames from this time step on are dropped
+
+    FieldSnapshot buffers[numBuffers];
+    bool pending[numBuffers];   // submitted, not written yet
+    size_t next;                // buffer handed out by acquire()
+    size_t writing;             // next buffer written by the thread, in the order of submission
+
+    size_t numWritten;
+    double waited;              // seconds acquire() waited for the writer
+
+    bool stop;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread writer;
+
+    void run();
+    void write(FieldSnapshot&);
+    void writeVTK(const FieldSnapshot&, const std::string&) const;
+    void writeXDMF(const FieldSnapshot&, const std::string&) const;
+    void writePNG(const FieldSnapshot&, const std::string&) const;
+    void writeSeries(const FieldSnapshot&);
+
+public:
+    FieldWriter(const std::string&, const unsigned& = vtkImageData | xdmfRaw, const ImageField& = imageSpeed, const real& range = 0.0,
+                const SeriesSettings& = SeriesSettings());
+    ~FieldWriter();
+
+    FieldWriter(const FieldWriter&) = delete;
+    FieldWriter& operator=(const FieldWriter&) = delete;
+
+    // The run continues after the given time step (0 for a new run): the frames of an existing
+    // series of later time steps are dropped when it is opened. Before the first submit(),
+    // without a call all its frames are dropped.
+    void continueAfter(const size_t&);
+
+    // Buffer for the next snapshot
+    FieldSnapshot& acquire();
+
+    // Hands the buffer of the last acquire() to the writer thread
+    void submit();
+
+    // Returns when all submitted snapshots are written
+    void flush();
+
+    size_t snapshotsWritten();
+
+    // Total time the callers of acquire() waited for a free buffer
+    double waitTime();
+};
+
+#endif
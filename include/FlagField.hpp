@@ -0,0 +1,119 @@
+#ifndef FLAGFIELD_HPP
+#define FLAGFIELD_HPP
+
+#include "Type.hpp"
+#include "Stencil.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <algorithm>    // std::min
+#include <cassert>
+
+// Halfway bounce back link: the f_q streaming into fluid cell (i,j) comes from an obstacle
+// (or wall) cell, so the cell's own f_opposite(q) is reflected instead
+struct BoundaryLink {
+    uint32_t i;
+    uint32_t q;
+};
+
+// Cell types of the domain, one bit per cell and type. Every row is padded to whole 64 bit
+// words, so the sweeps can test 64 cells at once for obstacles.
+//  obstacle: solid cell, never updated. The no-slip walls (ghost rows 0 and numCellsY - 1)
+//            are obstacles as well.
+//  boundary: fluid cell with at least one obstacle neighbour along a lattice velocity
+//            (periodic in x)
+//  fluid   : every cell that is not an obstacle
+// Same size as the lattice, i.e. including the ghost layers.
+class FlagField{
+
+private:
+    size_t numCellsX;  // This includes ghost cells
+    size_t numCellsY;
+    size_t wordsPerRow;
+
+    std::vector<uint64_t> obstacle_;
+    std::vector<uint64_t> boundary_;
+
+    static void setBit(std::vector<uint64_t>&, const size_t&, const size_t&, const size_t&, const bool&);
+
+public:
+    FlagField(const size_t&, const size_t&);
+
+    size_t sizeX() const { return numCellsX; }
+    size_t sizeY() const { return numCellsY; }
+
+    inline bool isObstacle(const size_t&, const size_t&) const;
+    inline bool isBoundary(const size_t&, const size_t&) const;
+    inline bool isFluid(const size_t& i, const size_t& j) const { return !isObstacle(i, j); }
+
+    void setObstacle(const size_t&, const size_t&, const bool& = true);
+
+    // Marks the cells whose centre lies inside the circle as obstacles. Centre and radius are
+    // in cells, measured from the lower left corner of the first non ghost cell.
+    void addCylinder(const real&, const real&, const real&);
+
+    // Marks the black pixels (value < 0.5) of a gray scale png as obstacles. The image is
+    // resized to the non ghost cells first, the lower left pixel is cell (1,1).
+    void addImage(const std::string&);
+
+    // Recomputes the boundary cells, done by the add functions
+    void updateBoundary();
+
+    // Column of the neighbour in x direction, the ghost columns are replaced by the periodic image
+    size_t periodicX(const size_t&) const;
+
+    // All bounce back links, sorted by row and column. The links of row j are
+    // [rowBegin[j], rowBegin[j+1]).
+    void boundaryLinks(std::vector<BoundaryLink>&, std::vector<size_t>&) const;
+
+    // No. of non ghost fluid cells
+    size_t fluidCells() const;
+    double fluidFraction() const;
+
+    // First fluid (obstacle) cell in [i, end) of row j, end if there is none.
+    // Tests 64 cells at a time.
+    inline size_t nextFluid(const size_t&, size_t, const size_t&) const;
+    inline size_t nextObstacle(const size_t&, size_t, const size_t&) const;
+};
+
+
+inline bool FlagField::isObstacle(const size_t& i, const size_t& j) const{
+
+    assert(i < numCellsX && j < numCellsY);
+    return (obstacle_[j*wordsPerRow + i/64] >> (i%64)) & 1U;
+}
+
+inline bool FlagField::isBoundary(const size_t& i, const size_t& j) const{
+
+    assert(i < numCellsX && j < numCellsY);
+    return (boundary_[j*wordsPerRow + i/64] >> (i%64)) & 1U;
+}
+
+inline size_t FlagField::nextObstacle(const size_t& j, size_t i, const size_t& end) const{
+
+    const uint64_t* row = &obstacle_[j*wordsPerRow];
+
+    while(i < end) {
+        const uint64_t word = row[i/64] >> (i%64);
+        if(word)
+            return std::min(end, i + __builtin_ctzll(word));
+        i = (i/64 + 1) * 64;
+    }
+    return end;
+}
+
+inline size_t FlagField::nextFluid(const size_t& j, size_t i, const size_t& end) const{
+
+    const uint64_t* row = &obstacle_[j*wordsPerRow];
+
+    while(i < end) {
+        const uint64_t word = ~row[i/64] >> (i%64);
+        if(word)
+            return std::min(end, i + __builtin_ctzll(word));
+        i = (i/64 + 1) * 64;
+    }
+    return end;
+}
+
+#endif
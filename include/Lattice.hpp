@@ -2,44 +2,113 @@
 #define LATTICE_HPP
 
 #include "Type.hpp"
+#include "Layout.hpp"
+#include "Storage.hpp"
+#include "LatticeAllocator.hpp"
 #include <vector>
 #include <map>
 #include <iostream>
 #include <cassert>
 
-#define NUM_DIR 9
-
+// The Layout policy (AoS, SoA, AoSoA<width>, see Layout.hpp) decides how the
+// f_q's are arranged in memory; operator() behaves identically for all of them.
+// The Storage policy (see Storage.hpp) decides the type they are kept as. operator()
+// returns the stored value, get() and set() convert from/to real.
+template<typename Layout, typename Storage>
 class Lattice{
 
+public:
+    typedef typename Storage::value_type value_type;
+
 private:
     size_t numCellsX;  // This includes ghost cells
     size_t numCellsY;
+    size_t numCells;   // numCellsX * numCellsY
 
     //vector to store probability density function(f_q) values.
-    std::vector<real> data_;
+    // Left uninitialised by the constructor, the values (and pages) are set in init()
+    std::vector<value_type, LatticeAllocator<value_type> > data_;
 
-    // init lattice weights
-    static constexpr real weights[] = {4.0/9.0, 1.0/9.0, 1.0/9.0, 1.0/9.0, 1.0/9.0, 1.0/36.0, 1.0/36.0, 1.0/36.0, 1.0/36.0};
+    void initRow(const size_t&);
 
 public:
     //Constructor
     Lattice(const size_t&, const size_t&);
 
-    // Sets the initails f_q's
+    // Sets the initails f_q's to the equilibrium at rest (rho = 1, u = 0)
+    // The rows are initialised in parallel with the same static schedule as the time steps
     void init();
 
+    size_t sizeX() const { return numCellsX; }
+    size_t sizeY() const { return numCellsY; }
+
+    // Raw f_q's in the order of the layout, for LatticeView
+    value_type* data() { return data_.data(); }
+
     //Non const version, used for assigning
-     real& operator() (const size_t&, const size_t&, const Direction&);
-     real& operator() (const size_t&, const size_t&, const size_t&);
+    // The accessors are defined inline below, so that the stream/collide loops can be optimised
+    inline value_type& operator() (const size_t&, const size_t&, const Direction&);
+    inline value_type& operator() (const size_t&, const size_t&, const size_t&);
 
     //Const version, used for accessing const array object, Safe(returns const reference)
     // This operator is never used in this assignment
-    const real& operator() (const size_t&, const size_t&, const Direction&) const;
-    const real& operator() (const size_t&, const size_t&, const size_t&) const;
+    inline const value_type& operator() (const size_t&, const size_t&, const Direction&) const;
+    inline const value_type& operator() (const size_t&, const size_t&, const size_t&) const;
+
+    // f_q converted to real
+    inline real get(const size_t&, const size_t&, const size_t&) const;
+    inline void set(const size_t&, const size_t&, const size_t&, const real&);
 
     void display() const;
 };
 
 
+template<typename Layout, typename Storage>
+inline typename Lattice<Layout, Storage>::value_type& Lattice<Layout, Storage>::operator() (const size_t& i, const size_t& j, const Direction& dir){
+
+   assert(i>=0 && j>=0  && i <numCellsX &&  j <numCellsY);
+    //std::cout << "NON const version operator() called\n";
+    return this->data_[Layout::index(j*numCellsX + i, dir, numCells)];
+}
+
+template<typename Layout, typename Storage>
+inline typename Lattice<Layout, Storage>::value_type& Lattice<Layout, Storage>::operator() (const size_t& i, const size_t& j, const size_t& k){
+
+    assert(i>=0 && j>=0 && k>=0 && i <numCellsX &&  j <numCellsY && k <Stencil::Q);
+    //std::cout << "NON const version operator() called\n";
+    return this->data_[Layout::index(j*numCellsX + i, k, numCells)];
+}
+
+template<typename Layout, typename Storage>
+inline const typename Lattice<Layout, Storage>::value_type& Lattice<Layout, Storage>::operator() (const size_t& i, const size_t& j, const Direction& dir) const{
+
+    assert(i>=0 && j>=0 && i <numCellsX &&  j <numCellsY);
+    //std::cout << "Const version operator() called\n";
+
+    return this->data_[Layout::index(j*numCellsX + i, dir, numCells)];
+}
+
+template<typename Layout, typename Storage>
+inline const typename Lattice<Layout, Storage>::value_type& Lattice<Layout, Storage>::operator() (const size_t& i, const size_t& j, const size_t& k) const{
+
+    assert(i>=0 && j>=0 && k>=0 && i <numCellsX &&  j <numCellsY && k <Stencil::Q);
+
+    return this->data_[Layout::index(j*numCellsX + i, k, numCells)];
+}
+
+template<typename Layout, typename Storage>
+inline real Lattice<Layout, Storage>::get(const size_t& i, const size_t& j, const size_t& k) const{
+
+    assert(i <numCellsX &&  j <numCellsY && k <Stencil::Q);
+    return Storage::load(this->data_[Layout::index(j*numCellsX + i, k, numCells)], Stencil::w[k]);
+}
+
+template<typename Layout, typename Storage>
+inline void Lattice<Layout, Storage>::set(const size_t& i, const size_t& j, const size_t& k, const real& f){
+
+    assert(i <numCellsX &&  j <numCellsY && k <Stencil::Q);
+    this->data_[Layout::index(j*numCellsX + i, k, numCells)] = Storage::store(f, Stencil::w[k]);
+}
+
 
 #endif
@@ -0,0 +1,47 @@
+#ifndef LATTICEALLOCATOR_HPP
+#define LATTICEALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdlib>      // posix_memalign, free
+#include <new>          // std::bad_alloc
+#include <utility>      // std::forward
+
+// Allocator for the lattice data.
+// The memory is aligned to 64 bytes (a cache line, one AVX-512 register), and the elements are
+// left uninitialised by std::vector::resize. The pages are therefore first touched in
+// Lattice::init(), by the same threads that update them later, which places them on the right
+// NUMA node.
+template<typename T>
+struct LatticeAllocator {
+
+    typedef T value_type;
+
+    static const size_t alignment = 64;
+
+    LatticeAllocator() {}
+    template<typename U>
+    LatticeAllocator(const LatticeAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        void* p = 0;
+        if(posix_memalign(&p, alignment, n * sizeof(T)) != 0)
+            throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, size_t) { free(p); }
+
+    // Default initialisation, i.e. no write for plain numbers
+    template<typename U>
+    void construct(U* p) { ::new(static_cast<void*>(p)) U; }
+
+    template<typename U, typename... Args>
+    void construct(U* p, Args&&... args) { ::new(static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+};
+
+template<typename T, typename U>
+bool operator== (const LatticeAllocator<T>&, const LatticeAllocator<U>&) { return true; }
+template<typename T, typename U>
+bool operator!= (const LatticeAllocator<T>&, const LatticeAllocator<U>&) { return false; }
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef LATTICEVIEW_HPP
+#define LATTICEVIEW_HPP
+
+#include "Lattice.hpp"
+#include <cstddef>
+#include <cassert>
+
+// Non owning view of the f_q's of a Lattice, for the stream/collide kernels.
+// It keeps a raw pointer to the data (restrict, the kernels never reach the f_q's of a lattice
+// in another way while they use a view), the strides of the cell index and a table of the
+// neighbour offsets, so the index of a neighbour's f_q is one addition away. For the unit
+// stride layouts the start of every direction is precomputed as well.
+// The accesses are only checked in debug builds, the checked accessors are those of Lattice.
+// A view is cheap to copy and stays valid as long as the lattice is not resized.
+template<typename Layout, typename Storage>
+class LatticeView{
+
+public:
+    typedef typename Storage::value_type value_type;
+
+private:
+    value_type* __restrict__ data_;
+
+    size_t numCellsX;  // This includes ghost cells, the stride of j in the cell index
+    size_t numCellsY;
+    size_t numCells;
+
+    // Cell index offset of the neighbour in direction q, c_q = (Stencil::cx[q], Stencil::cy[q])
+    std::ptrdiff_t neighbour_[Stencil::Q];
+
+    // Unit stride layouts: position of f_q of cell 0
+    size_t direction_[Stencil::Q];
+
+public:
+    explicit LatticeView(Lattice<Layout, Storage>& lattice)
+        : data_(lattice.data()), numCellsX(lattice.sizeX()), numCellsY(lattice.sizeY()),
+          numCells(lattice.sizeX() * lattice.sizeY())
+    {
+        for(size_t q=0; q< Stencil::Q; ++q){
+            neighbour_[q] = Stencil::cx[q] + Stencil::cy[q] * std::ptrdiff_t(numCellsX);
+            direction_[q] = Layout::index(0, q, numCells);
+        }
+    }
+
+    size_t sizeX() const { return numCellsX; }
+    size_t sizeY() const { return numCellsY; }
+
+    size_t cell(const size_t& i, const size_t& j) const {
+        assert(i < numCellsX && j < numCellsY);
+        return j*numCellsX + i;
+    }
+
+    // Cell index of the neighbour of cell in direction q
+    size_t neighbour(const size_t& cell, const size_t& q) const { return cell + neighbour_[q]; }
+
+    value_type& operator() (const size_t& cell, const size_t& q) const {
+        assert(cell < numCells && q < Stencil::Q);
+        return Layout::unitStride ? data_[direction_[q] + cell] : data_[Layout::index(cell, q, numCells)];
+    }
+
+    value_type& operator() (const size_t& i, const size_t& j, const size_t& q) const {
+        return (*this)(cell(i, j), q);
+    }
+};
+
+#endif
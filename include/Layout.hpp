@@ -0,0 +1,60 @@
+#ifndef LAYOUT_HPP
+#define LAYOUT_HPP
+
+#include "Type.hpp"
+#include "Stencil.hpp"
+#include <cstddef>
+
+// Layout policies for the Lattice class. Each policy maps a linear cell index
+// (j*numCellsX + i) and a direction q onto the position of f_q inside data_.
+// size() returns the no. of reals to allocate for numCells cells.
+// unitStride tells whether neighbouring cells of one direction are adjacent in memory,
+// which is what the vectorised collide kernels (CollideKernels.hpp) require.
+
+// Array of Structures: the Stencil::Q populations of one cell are adjacent
+struct AoS {
+
+    static const char* name() { return "AoS"; }
+    static constexpr bool unitStride = false;
+
+    static size_t size(const size_t& numCells) { return Stencil::Q * numCells; }
+
+    static size_t index(const size_t& cell, const size_t& q, const size_t& /*numCells*/) {
+        return Stencil::Q * cell + q;
+    }
+};
+
+// Structure of Arrays: one contiguous array per direction, unit stride along x
+struct SoA {
+
+    static const char* name() { return "SoA"; }
+    static constexpr bool unitStride = true;
+
+    static size_t size(const size_t& numCells) { return Stencil::Q * numCells; }
+
+    static size_t index(const size_t& cell, const size_t& q, const size_t& numCells) {
+        return q * numCells + cell;
+    }
+};
+
+// Array of Structures of Arrays: cells are grouped into blocks of BlockWidth,
+// inside a block every direction is stored as a short SoA vector
+template<size_t BlockWidth>
+struct AoSoA {
+
+    static_assert(BlockWidth > 0, "AoSoA block width must be positive");
+
+    static const char* name() { return BlockWidth == 4 ? "AoSoA4" : BlockWidth == 8 ? "AoSoA8" : "AoSoA"; }
+    static constexpr bool unitStride = false;
+
+    // The last block is padded up to the full width
+    static size_t size(const size_t& numCells) {
+        return Stencil::Q * BlockWidth * ((numCells + BlockWidth - 1) / BlockWidth);
+    }
+
+    static size_t index(const size_t& cell, const size_t& q, const size_t& /*numCells*/) {
+        return (cell / BlockWidth) * BlockWidth * Stencil::Q + q * BlockWidth + cell % BlockWidth;
+    }
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef LOG_HPP
+#define LOG_HPP
+
+#include <sstream>
+#include <string>
+
+// Leveled logging of the diagnostics. A message is formatted by the calling thread and put
+// into a lock-free ring buffer, a background thread writes it to the console (debug and info
+// to std::cout, warnings and errors to std::cerr). So the calling thread never waits for the
+// console or flushes it, and the messages of several threads are not mixed up.
+//
+//     LOG_INFO("MLUPS :" << mlups);
+//
+// Messages below LBM_LOG_LEVEL are removed at compile time, together with the formatting.
+// Of the remaining ones those below the runtime level are skipped, which is info unless the
+// environment variable LBM_LOG_LEVEL (debug, info, warning, error or off) says otherwise.
+// The ring buffer is written out at program exit, logFlush() does it right away.
+
+typedef enum { logDebug = 0, logInfo, logWarning, logError, logOff } LogLevel;
+
+// Release builds strip the debug messages, e.g. the ones of the BC's called every time step
+#ifndef LBM_LOG_LEVEL
+#ifdef NDEBUG
+#define LBM_LOG_LEVEL 1
+#else
+#define LBM_LOG_LEVEL 0
+#endif
+#endif
+
+// Messages below the runtime level are skipped
+LogLevel logLevel();
+void setLogLevel(const LogLevel&);
+
+// Queues a message, called by the macros below
+void logWrite(const LogLevel&, const std::string&);
+
+// Returns when all messages queued so far are written out, before printing to the console directly
+void logFlush();
+
+#define LBM_LOG(level, message) \
+    do { \
+        if((level) >= LBM_LOG_LEVEL && (level) >= logLevel()) { \
+            std::ostringstream logStream_; \
+            logStream_ << message; \
+            logWrite(level, logStream_.str()); \
+        } \
+    } while(0)
+
+#define LOG_DEBUG(message)   LBM_LOG(logDebug, message)
+#define LOG_INFO(message)    LBM_LOG(logInfo, message)
+#define LOG_WARNING(message) LBM_LOG(logWarning, message)
+#define LOG_ERROR(message)   LBM_LOG(logError, message)
+
+#endif
@@ -2,6 +2,7 @@
 #define SIMULATIONPARAMETERS_HPP
 
 #include "Type.hpp"
+#include "FlagField.hpp"
 #include <iostream>
 #include <stdexcept>
 #include <stdlib.h>     /* atoi */
@@ -13,6 +14,7 @@ using namespace std;
 extern real nx, ny;
 extern real latticeVisc, latticeAcc;
 extern real relaxRate; //relaxation rate
+extern size_t timeSteps; // no. of time steps to reach simTime
 
 class Parameters
 {
@@ -30,6 +32,11 @@ public:
     inline real convVisc(real visc, real dx, real dt);
     inline real convAcc(real acc, real dx, real dt);
 
+    // Rasterizes the obstacles into flags: "none", "cylinder" (the cylinder of the scenario,
+    // scaled if flags is not the size of the scenario's grid) or the name of a png mask.
+    // Only after calcDomDim().
+    void buildGeometry(FlagField& flags, const std::string& geometry) const;
+
 private:
 
     real length_, width_, dia_, centerX_, centerY_;
@@ -0,0 +1,141 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include "Type.hpp"
+#include <cstddef>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+// Thin wrappers around the SIMD registers of the different instruction sets, so that the
+// collide kernels are written once (see CollideRow.hpp) and instantiated per instruction set.
+// Computations are always done in doubles, loads and stores convert from/to float storage.
+// Only the wrappers enabled by the compiler flags of the including file are available.
+//
+// The kernels keep their arrays of V in registers only if every helper is inlined, the
+// compiler's heuristics give up on the larger ones (the collision operators), hence
+// LBM_ALWAYS_INLINE.
+//
+// This header is compiled once per instruction set with different flags. The unnamed namespace
+// gives every translation unit its own copy, so the linker can never mix them up.
+#define LBM_ALWAYS_INLINE inline __attribute__((always_inline))
+
+namespace {
+
+// One lane, used for the remainder of a row and as generic fallback
+struct VecScalar {
+
+    static const size_t width = 1;
+    static const char* name() { return "scalar"; }
+
+    real v;
+
+    VecScalar() {}
+    explicit VecScalar(const real& x) : v(x) {}
+
+    static VecScalar load(const double* p) { return VecScalar(*p); }
+    static VecScalar load(const float* p) { return VecScalar(*p); }
+    void store(double* p) const { *p = v; }
+    void store(float* p) const { *p = float(v); }
+};
+
+inline VecScalar operator+ (const VecScalar& a, const VecScalar& b) { return VecScalar(a.v + b.v); }
+inline VecScalar operator- (const VecScalar& a, const VecScalar& b) { return VecScalar(a.v - b.v); }
+inline VecScalar operator* (const VecScalar& a, const VecScalar& b) { return VecScalar(a.v * b.v); }
+inline VecScalar operator/ (const VecScalar& a, const VecScalar& b) { return VecScalar(a.v / b.v); }
+// a*b + c
+inline VecScalar fmadd(const VecScalar& a, const VecScalar& b, const VecScalar& c) { return VecScalar(a.v * b.v + c.v); }
+inline VecScalar sqrt(const VecScalar& a) { return VecScalar(std::sqrt(a.v)); }
+
+
+#ifdef __SSE2__
+// 2 doubles
+struct VecSSE2 {
+
+    static const size_t width = 2;
+    static const char* name() { return "sse2"; }
+
+    __m128d v;
+
+    VecSSE2() {}
+    explicit VecSSE2(const real& x) : v(_mm_set1_pd(x)) {}
+    VecSSE2(const __m128d& x) : v(x) {}
+
+    static VecSSE2 load(const double* p) { return VecSSE2(_mm_loadu_pd(p)); }
+    static VecSSE2 load(const float* p) { return VecSSE2(_mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))))); }
+    void store(double* p) const { _mm_storeu_pd(p, v); }
+    void store(float* p) const { _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_castps_si128(_mm_cvtpd_ps(v))); }
+};
+
+inline VecSSE2 operator+ (const VecSSE2& a, const VecSSE2& b) { return _mm_add_pd(a.v, b.v); }
+inline VecSSE2 operator- (const VecSSE2& a, const VecSSE2& b) { return _mm_sub_pd(a.v, b.v); }
+inline VecSSE2 operator* (const VecSSE2& a, const VecSSE2& b) { return _mm_mul_pd(a.v, b.v); }
+inline VecSSE2 operator/ (const VecSSE2& a, const VecSSE2& b) { return _mm_div_pd(a.v, b.v); }
+inline VecSSE2 fmadd(const VecSSE2& a, const VecSSE2& b, const VecSSE2& c) { return _mm_add_pd(_mm_mul_pd(a.v, b.v), c.v); }
+inline VecSSE2 sqrt(const VecSSE2& a) { return _mm_sqrt_pd(a.v); }
+#endif
+
+
+#if defined(__AVX2__) && defined(__FMA__)
+// 4 doubles
+struct VecAVX2 {
+
+    static const size_t width = 4;
+    static const char* name() { return "avx2"; }
+
+    __m256d v;
+
+    VecAVX2() {}
+    explicit VecAVX2(const real& x) : v(_mm256_set1_pd(x)) {}
+    VecAVX2(const __m256d& x) : v(x) {}
+
+    static VecAVX2 load(const double* p) { return VecAVX2(_mm256_loadu_pd(p)); }
+    static VecAVX2 load(const float* p) { return VecAVX2(_mm256_cvtps_pd(_mm_loadu_ps(p))); }
+    void store(double* p) const { _mm256_storeu_pd(p, v); }
+    void store(float* p) const { _mm_storeu_ps(p, _mm256_cvtpd_ps(v)); }
+};
+
+inline VecAVX2 operator+ (const VecAVX2& a, const VecAVX2& b) { return _mm256_add_pd(a.v, b.v); }
+inline VecAVX2 operator- (const VecAVX2& a, const VecAVX2& b) { return _mm256_sub_pd(a.v, b.v); }
+inline VecAVX2 operator* (const VecAVX2& a, const VecAVX2& b) { return _mm256_mul_pd(a.v, b.v); }
+inline VecAVX2 operator/ (const VecAVX2& a, const VecAVX2& b) { return _mm256_div_pd(a.v, b.v); }
+inline VecAVX2 fmadd(const VecAVX2& a, const VecAVX2& b, const VecAVX2& c) { return _mm256_fmadd_pd(a.v, b.v, c.v); }
+inline VecAVX2 sqrt(const VecAVX2& a) { return _mm256_sqrt_pd(a.v); }
+#endif
+
+
+#ifdef __AVX512F__
+// 8 doubles
+struct VecAVX512 {
+
+    static const size_t width = 8;
+    static const char* name() { return "avx512"; }
+
+    __m512d v;
+
+    VecAVX512() {}
+    explicit VecAVX512(const real& x) : v(_mm512_set1_pd(x)) {}
+    VecAVX512(const __m512d& x) : v(x) {}
+
+    static VecAVX512 load(const double* p) { return VecAVX512(_mm512_loadu_pd(p)); }
+    // The conversions with all lanes set in the mask: the unmasked ones start from an undefined
+    // register, which GCC flags as maybe uninitialized
+    static VecAVX512 load(const float* p) { return VecAVX512(_mm512_maskz_cvtps_pd(0xFF, _mm256_loadu_ps(p))); }
+    void store(double* p) const { _mm512_storeu_pd(p, v); }
+    void store(float* p) const { _mm256_storeu_ps(p, _mm512_maskz_cvtpd_ps(0xFF, v)); }
+};
+
+inline VecAVX512 operator+ (const VecAVX512& a, const VecAVX512& b) { return _mm512_add_pd(a.v, b.v); }
+inline VecAVX512 operator- (const VecAVX512& a, const VecAVX512& b) { return _mm512_sub_pd(a.v, b.v); }
+inline VecAVX512 operator* (const VecAVX512& a, const VecAVX512& b) { return _mm512_mul_pd(a.v, b.v); }
+inline VecAVX512 operator/ (const VecAVX512& a, const VecAVX512& b) { return _mm512_div_pd(a.v, b.v); }
+inline VecAVX512 fmadd(const VecAVX512& a, const VecAVX512& b, const VecAVX512& c) { return _mm512_fmadd_pd(a.v, b.v, c.v); }
+// Masked for the same reason as the conversions of load and store
+inline VecAVX512 sqrt(const VecAVX512& a) { return _mm512_maskz_sqrt_pd(0xFF, a.v); }
+#endif
+
+} // namespace
+
+#endif
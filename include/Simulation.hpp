@@ -2,40 +2,219 @@
 #define SIMULATION_HPP
 
 #include "Lattice.hpp"
+#include "LatticeView.hpp"
+#include "CollideKernels.hpp"
+#include "FlagField.hpp"
+#include "FieldWriter.hpp"
+#include "Checkpoint.hpp"
 #include <memory>       //for shared pointer
 
+// The simulation is instantiated for every memory layout (see Layout.hpp) and storage
+// type (see Storage.hpp) of the lattice
+template<typename Layout, typename Storage>
 class Simulation{
 
+    typedef typename Storage::value_type value_type;
+
 private:
     //src and dest points to a lattice object, from/to where the information is to be read and written resp;
-    std::shared_ptr<Lattice> src;   // Similar to Lattice *src
-    std::shared_ptr<Lattice> dest;
+    // Single lattice propagations only allocate src.
+    std::shared_ptr<Lattice<Layout, Storage> > src;   // Similar to Lattice *src
+    std::shared_ptr<Lattice<Layout, Storage> > dest;
 
     size_t numCellsX;  // This includes ghost cells
     size_t numCellsY;
 
-    // Arrays to denote the  vectors in x and y directions.
-    static constexpr int dir_x[] = {0, 0, 0, -1, 1, 1, -1, -1, 1};
-    static constexpr int dir_y[] = {0, 1, -1, 0, 0, 1, 1, -1, -1};
+    Propagation propagation;
+
+    // Fluid and obstacle cells, obstacle cells are skipped by the sweeps
+    FlagField flags;
+
+    // Bounce back links of the walls and obstacles, built once per geometry. Row j has the
+    // links [linkRowBegin[j], linkRowBegin[j+1]), sorted by column.
+    std::vector<BoundaryLink> links;
+    std::vector<size_t> linkRowBegin;
+
+    // Tile size of the sweeps, 0 means the whole row / the whole slab of a thread
+    size_t tileX;
+    size_t tileY;
+
+    // No. of time steps done per pass over the lattice (temporal blocking), 1 = none
+    size_t blockSteps;
+    size_t timeStep;   // No. of time steps performed, decides the parity of the AA pattern
+
+    // Esoteric Twist: the direction slot holding f_q, the slots of q and opposite(q) are
+    // swapped after every step (the "twist")
+    size_t twistSlot[Stencil::Q];
+
+    // Collision operator and its vectorised kernel, selected at startup.
+    // smagorinsky is the Smagorinsky constant C_s of the LES, 0 without.
+    CollisionModel collision;
+    real smagorinsky;
+    CollideKernelInfo<value_type> collideKernel;
+
+    // Body acceleration, constant and per cell (empty if none), applied in the collision
+    real accX, accY;
+    std::vector<real> accFieldX, accFieldY;
+
+    // Snapshots of the fields every outputInterval time steps of runSimulation(), if set
+    std::shared_ptr<FieldWriter> writer;
+    size_t outputInterval;
+
+    // PNG images of the speed or vorticity every imageInterval time steps of runSimulation(),
+    // from snapshots downsampled by imageSpacing
+    std::shared_ptr<FieldWriter> imageWriter;
+    size_t imageInterval;
+    size_t imageSpacing;
+
+    // Checkpoint written every checkpointInterval time steps of runSimulation(), 0 for none
+    std::string checkpointPath;
+    size_t checkpointInterval;
+
+    // The kernels access the lattices through views, with the neighbour offsets of Stencil
+    typedef LatticeView<Layout, Storage> View;
+    static View view(Lattice<Layout, Storage>& lattice) { return View(lattice); }
+
+    // Column i of the lattice, with Periodic the ghost columns are replaced by their periodic
+    // image (the last / first non ghost column), so the periodic BC's are part of the streaming
+    template<bool Periodic>
+    static size_t column(const size_t& i, const size_t& nX) {
+        return Periodic ? (i == 0 ? nX - 2 : (i == nX - 1 ? 1 : i)) : i;
+    }
+
+    // Where a cell reads its streamed f_q's (in) and writes the collided ones (out),
+    // one access struct per propagation step, defined in Simulation.cpp.
+    // Periodic wraps the x index, only needed for the first and last column, periodic()
+    // returns the wrapping variant of an access.
+    template<bool Periodic> struct PullAccess;
+    template<bool Periodic> struct AAEvenAccess;
+    template<bool Periodic> struct AAOddAccess;
+    template<bool Periodic> struct EsoTwistAccess;
+    struct IncomingAccess;
+
+    // Location of the f_q streaming into cell (i,j) in the next time step. The BC's
+    // are expressed with it, so they work for every propagation.
+    value_type& incoming(const size_t&, const size_t&, const size_t&);
+
+    // Fused stream and collide over all fluid cells with the given access.
+    // Every thread sweeps its slab of rows tile by tile.
+    template<typename Access>
+    void sweep(const Access&);
+
+    // Fused stream and collide of the fluid cells in [iBegin, iEnd) of row j
+    template<typename Access>
+    void sweepRow(const Access&, const size_t&, const size_t&, const size_t&, const CollisionRates&);
+
+    // Fused stream and collide of the cells [iBegin, iEnd) of row j, all of them fluid
+    template<typename Access>
+    void sweepRun(const Access&, const size_t&, const size_t&, const size_t&, const CollisionRates&);
+
+    // Initial state: rest equilibrium, no time step done yet
+    void initState();
+
+    // Bounce back of the f_q's streaming from walls and obstacles into the cells [iBegin, iEnd)
+    // of row j, from the link list
+    template<typename Access>
+    void bounceBackRow(const Access&, const size_t&, const size_t&, const size_t&);
+
+    // k time steps of the two lattice scheme in one pass over the lattice. The rows are
+    // updated in a wavefront, each step lagging two rows behind the previous one, so the
+    // rows of all k levels stay in cache.
+    void wavefrontSteps(const size_t&);
+
+    // Density and velocity of the non ghost cells from the f_q's the access streams in,
+    // averaged over the blocks of a downsampled snapshot. Every thread does whole rows of blocks.
+    template<typename Access>
+    void macroscopicRows(const Access&, FieldSnapshot&) const;
+
+    // Header of a checkpoint of the current state
+    CheckpointHeader stateHeader() const;
+
+    // Fills force for the cells from cell on, 0 if the lattice is not accelerated
+    const BodyForce* bodyForce(BodyForce& force, const size_t& cell) const;
 
 public:
-    Simulation(const size_t&, const size_t&);
+    Simulation(const size_t&, const size_t&, const Propagation& = twoLattice, const CollisionModel& = bgk, const real& = 0.0);
 
     // Prints lattice contents
     void printLattice();
 
-    // Sets the periodic BC's in East and West directions
-    void setPeriodicBCs();
+    // Sets the obstacles, flags must have the size of the lattice (including ghost layers)
+    void setGeometry(const FlagField&);
+    const FlagField& flagField() const { return flags; }
+
+    // No. of fluid cells updated per time step
+    size_t fluidCells() const { return flags.fluidCells(); }
 
-    // Sets the reflecting BC's in North and South directions
+    // Sets the reflecting BC's at the walls (North and South) and the obstacles
     void setNoSlipBCs();
 
     // Stream and collide are coded in one function to implement loop fusion
     void stream_Collide();
 
-    // Perform all simulation steps of LBM
+    // Perform all simulation steps of LBM, reports the performance in MLUPS at the end
     void runSimulation();
 
+    // Performs the given no. of time steps (BC's, stream and collide), without reporting
+    void advance(const size_t&);
+
+    // Name of the collide kernel the rows are swept with
+    const char* collideKernelName() const;
+
+    // Collision operator, see Collision.hpp
+    const CollisionModel& collisionModel() const { return collision; }
+
+    // Sets the tile size (in cells) of the sweeps, 0 for no tiling in that direction
+    void setTileSize(const size_t&, const size_t&);
+
+    // Times the sweeps for a set of tile sizes on this grid and keeps the fastest one.
+    // Reports the achieved bandwidth relative to the STREAM triad. Only before the first
+    // time step, the lattice is re-initialised afterwards.
+    void autotuneTileSize();
+
+    // Memory traffic of one cell update in bytes
+    double bytesPerCellUpdate() const;
+
+    // Time steps per pass over the lattice in runSimulation(), k > 1 only with two lattices
+    void setTemporalBlocking(const size_t&);
+
+    // Body acceleration in lattice units (e.g. latticeAcc in x to drive a channel), applied
+    // with the Guo forcing in the collision. The per cell acceleration is added to the constant
+    // one, the fields have the size of the lattice (including ghost layers), cell j*numCellsX + i.
+    void setAcceleration(const real&, const real&);
+    void setAccelerationField(const std::vector<real>&, const std::vector<real>&);
+
+    // Density and velocity of the cells after the last time step. The velocity includes half
+    // the body force (Guo), u = (sum_q c_q f_q + F/2) / rho. With spacing > 1 the means of
+    // the fluid cells of spacing x spacing blocks, in the same pass over the lattice.
+    void macroscopicFields(FieldSnapshot&, const size_t& spacing = 1);
+
+    // Writes the fields every interval time steps of runSimulation() to files starting with
+    // prefix, from a background thread (see FieldWriter.hpp). series holds the error bounds of
+    // the compressedSeries format.
+    void setOutput(const std::string&, const size_t&, const unsigned& = vtkImageData | xdmfRaw, const SeriesSettings& = SeriesSettings());
+
+    // Renders a PNG image of the speed or vorticity every interval time steps of runSimulation()
+    // for monitoring, files starting with prefix. The lattice is reduced to at most
+    // MAX_IMAGE_SIZE pixels per side (spacing 0) or to one pixel per spacing x spacing cells,
+    // the image is encoded by a background thread. range as in FieldWriter.hpp.
+    void setImages(const std::string&, const size_t&, const ImageField& = imageSpeed, const real& range = 0.0, const size_t& spacing = 0);
+
+    // Writes the state (f_q's, time step, propagation state) and the constants of the run to a
+    // checkpoint file, see Checkpoint.hpp
+    void writeCheckpoint(const std::string&) const;
+
+    // Continues from a checkpoint of a simulation with the same lattice (size, layout, storage
+    // type, propagation) and geometry, throws std::runtime_error otherwise. runSimulation()
+    // then does the remaining time steps.
+    void readCheckpoint(const std::string&);
+
+    // Writes a checkpoint every interval time steps of runSimulation() and at its end
+    void setCheckpoint(const std::string&, const size_t&);
+
+    // No. of time steps done
+    size_t timeStepsDone() const { return timeStep; }
+
 };
 
 #endif
@@ -0,0 +1,102 @@
+#ifndef SPARSESIMULATION_HPP
+#define SPARSESIMULATION_HPP
+
+#include "Type.hpp"
+#include "Storage.hpp"
+#include "FlagField.hpp"
+#include "LatticeAllocator.hpp"
+#include "CollideKernels.hpp"
+#include "FieldWriter.hpp"
+#include <vector>
+#include <cstdint>
+#include <memory>
+
+// Below this fluid fraction main() switches from the dense lattice to the sparse one.
+// With fewer fluid cells the sparse lattice is faster (and always needs less memory), with
+// more the indirect addressing costs more than it saves (measured with lbm_bench on porous masks).
+#define SPARSE_FLUID_FRACTION 0.6
+
+// Two lattice pull scheme on the fluid cells only (indirect addressing).
+// The f_q's of the fluid cells are stored in SoA order, cell k of direction q at q*numFluid + k.
+// For every cell and direction a precomputed index tells where the f_q streaming into the
+// cell is read from. The periodic BC's and the bounce back at walls and obstacles are part of
+// these indices, so no ghost layers have to be filled between the time steps.
+// Meant for geometries with many obstacle cells, which cost no memory and bandwidth here.
+template<typename Storage>
+class SparseSimulation{
+
+    typedef typename Storage::value_type value_type;
+
+private:
+    size_t numCellsX;  // This includes ghost cells
+    size_t numCellsY;
+    size_t numFluid;
+
+    std::vector<value_type, LatticeAllocator<value_type> > src;
+    std::vector<value_type, LatticeAllocator<value_type> > dest;
+
+    // (q-1)*numFluid + k: position in src of the f_q pulled by fluid cell k, q = 1 ... 8.
+    // The rest population is always read from the cell itself.
+    std::vector<uint32_t, LatticeAllocator<uint32_t> > neighbour;
+
+    // Fluid cell k is cell j*numCellsX + i, and the other way round (-1 for obstacles). 32 bit,
+    // the constructor rejects larger lattices
+    std::vector<uint32_t> cells;
+    std::vector<uint32_t> fluidIndex;
+
+    size_t timeStep;
+
+    // Vectorised collision of the gathered f_q's, selected at startup.
+    // smagorinsky is the Smagorinsky constant C_s of the LES, 0 without.
+    CollideKernelInfo<value_type> collideKernel;
+    real smagorinsky;
+
+    // Body acceleration, constant and per fluid cell (empty if none)
+    real accX, accY;
+    std::vector<real> accFieldX, accFieldY;
+
+    // Snapshots of the fields every outputInterval time steps of runSimulation(), if set
+    std::shared_ptr<FieldWriter> writer;
+    size_t outputInterval;
+
+    // Cells per gather block, the f_q's of a block are collected into contiguous rows
+    // and collided by collideKernel
+    static const size_t blockSize = 128;
+
+    // Rest equilibrium, the pages are touched by the threads updating them later
+    void init();
+
+public:
+    // Throws std::invalid_argument if the cells or the f_q's of the fluid cells are too many
+    // for the 32 bit indices
+    SparseSimulation(const FlagField&, const CollisionModel& = bgk, const real& = 0.0);
+
+    // f_q of cell (i,j) after the last collision (before streaming), only fluid cells
+    real get(const size_t&, const size_t&, const size_t&) const;
+    void set(const size_t&, const size_t&, const size_t&, const real&);
+
+    // One time step, stream (including the BC's) and collide
+    void stream_Collide();
+
+    // Performs the given no. of time steps, without reporting
+    void advance(const size_t&);
+
+    // Perform all simulation steps of LBM, reports the performance in MLUPS at the end
+    void runSimulation();
+
+    // Memory traffic of one cell update in bytes, including the neighbour indices
+    double bytesPerCellUpdate() const;
+
+    // Body acceleration, as in Simulation (the fields have the size of the dense lattice)
+    void setAcceleration(const real&, const real&);
+    void setAccelerationField(const std::vector<real>&, const std::vector<real>&);
+
+    // Macroscopic fields and their output, as in Simulation
+    void macroscopicFields(FieldSnapshot&) const;
+    void setOutput(const std::string&, const size_t&, const unsigned& = vtkImageData | xdmfRaw, const SeriesSettings& = SeriesSettings());
+
+    size_t fluidCells() const { return numFluid; }
+    const char* collideKernelName() const { return collideKernel.name; }
+};
+
+#endif
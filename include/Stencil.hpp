@@ -0,0 +1,106 @@
+#ifndef STENCIL_HPP
+#define STENCIL_HPP
+
+#include "Type.hpp"
+#include <cstddef>
+
+// Lattice velocity sets (stencils) DdQq as compile time descriptors: the lattice velocities
+// c_q = (cx[q], cy[q]), the weights w[q] and the opposite direction of each q. The engine is
+// 2D, so D2Q9 is the only stencil: a 3D one would need a 3D Lattice, FlagField and kernels.
+// Everything is constexpr, so loops over q have a constant trip count and are unrolled.
+// The descriptors are partial specialisations of DdQq (the last parameter is a dummy), so
+// their tables can be defined in this header.
+template<size_t D, size_t Q, typename = void>
+struct DdQq;
+
+template<typename Dummy>
+struct DdQq<2, 9, Dummy> {
+
+    static const char* name() { return "D2Q9"; }
+    static constexpr size_t dim = 2;
+    static constexpr size_t Q = 9;
+
+    // Same order as Direction in Type.hpp
+    static constexpr int cx[Q] = {0, 0, 0, -1, 1, 1, -1, -1, 1};
+    static constexpr int cy[Q] = {0, 1, -1, 0, 0, 1, 1, -1, -1};
+    static constexpr real w[Q] = {4.0/9.0, 1.0/9.0, 1.0/9.0, 1.0/9.0, 1.0/9.0, 1.0/36.0, 1.0/36.0, 1.0/36.0, 1.0/36.0};
+    static constexpr int opposite[Q] = {0, 2, 1, 4, 3, 7, 8, 5, 6};
+};
+
+#define LBM_DEFINE_STENCIL_TABLES(D, Q) \
+    template<typename Dummy> constexpr int DdQq<D, Q, Dummy>::cx[]; \
+    template<typename Dummy> constexpr int DdQq<D, Q, Dummy>::cy[]; \
+    template<typename Dummy> constexpr real DdQq<D, Q, Dummy>::w[]; \
+    template<typename Dummy> constexpr int DdQq<D, Q, Dummy>::opposite[];
+
+LBM_DEFINE_STENCIL_TABLES(2, 9)
+
+#undef LBM_DEFINE_STENCIL_TABLES
+
+typedef DdQq<2, 9> D2Q9;
+
+
+// Compile time checks of a stencil: opposite directions, the weights and the isotropy of the
+// moments up to fourth order, sum_q w_q c_qa c_qb = cs^2 delta_ab with cs^2 = 1/3 and so on.
+// C++11 constexpr functions are single expressions, hence the recursion over q.
+namespace stencil {
+
+template<typename St>
+constexpr int c(const size_t& a, const size_t& q) {
+    return a == 0 ? St::cx[q] : St::cy[q];
+}
+
+template<typename St>
+constexpr bool oppositeConsistent(const size_t& q = 0) {
+    return q == St::Q ||
+           (St::opposite[St::opposite[q]] == int(q) &&
+            St::cx[St::opposite[q]] == -St::cx[q] && St::cy[St::opposite[q]] == -St::cy[q] &&
+            St::w[St::opposite[q]] == St::w[q] &&
+            oppositeConsistent<St>(q + 1));
+}
+
+// sum_q w_q c_qa c_qb c_qc c_qd, components >= dim stand for a factor 1
+template<typename St>
+constexpr real moment(const size_t& a, const size_t& b, const size_t& e, const size_t& d, const size_t& q = 0) {
+    return q == St::Q ? 0.0 :
+           St::w[q] * (a < St::dim ? c<St>(a, q) : 1) * (b < St::dim ? c<St>(b, q) : 1)
+                    * (e < St::dim ? c<St>(e, q) : 1) * (d < St::dim ? c<St>(d, q) : 1)
+           + moment<St>(a, b, e, d, q + 1);
+}
+
+constexpr bool near(const real& x, const real& y) {
+    return x - y < 1e-14 && y - x < 1e-14;
+}
+
+// Moments of the axes a != b
+template<typename St>
+constexpr bool isotropic(const size_t& a, const size_t& b) {
+    return near(moment<St>(a, 3, 3, 3), 0.0) &&               // sum w c_a = 0
+           near(moment<St>(a, a, 3, 3), 1.0 / 3.0) &&         // sum w c_a c_a = cs^2
+           near(moment<St>(a, b, 3, 3), 0.0) &&
+           near(moment<St>(a, a, a, 3), 0.0) &&
+           near(moment<St>(a, a, a, a), 1.0 / 3.0) &&         // 3 cs^4
+           near(moment<St>(a, a, b, b), 1.0 / 9.0);           // cs^4
+}
+
+template<typename St>
+constexpr bool valid() {
+    return oppositeConsistent<St>() && near(moment<St>(3, 3, 3, 3), 1.0) &&
+           isotropic<St>(0, 1) && isotropic<St>(1, 0);
+}
+
+} // namespace stencil
+
+static_assert(stencil::valid<D2Q9>(), "D2Q9 stencil is inconsistent");
+
+
+// The stencil of the engine: Lattice, Simulation, FlagField and the collide kernels work on
+// 2D lattices with the D2Q9 velocities (the operators of CollideRow.hpp are written out for
+// the directions of Direction).
+typedef D2Q9 Stencil;
+
+static_assert(Stencil::cx[E] == 1 && Stencil::cy[N] == 1 && Stencil::cx[NE] == 1 && Stencil::cy[NE] == 1 &&
+              Stencil::cx[SW] == -1 && Stencil::cy[SW] == -1 && Stencil::opposite[NW] == SE,
+              "Direction must follow the order of the D2Q9 stencil");
+
+#endif
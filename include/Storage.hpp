@@ -0,0 +1,37 @@
+#ifndef STORAGE_HPP
+#define STORAGE_HPP
+
+#include "Type.hpp"
+
+// Storage policies for the Lattice class. value_type is what a f_q is kept as in memory,
+// all computations are done in real. load() and store() convert between the two, shift
+// is the weight w_q of the direction.
+
+// f_q stored as it is, in T
+template<typename T>
+struct PlainStorage {
+
+    typedef T value_type;
+    static constexpr bool shifted = false;
+
+    static const char* name() { return sizeof(T) == sizeof(float) ? "float" : "double"; }
+
+    static real load(const T& v, const real& /*shift*/) { return real(v); }
+    static T store(const real& f, const real& /*shift*/) { return T(f); }
+};
+
+// Only the deviation f_q - w_q from the equilibrium at rest is stored in T. The deviations are
+// small, so a float keeps many more significant digits of f_q than a plain float would.
+template<typename T>
+struct ShiftedStorage {
+
+    typedef T value_type;
+    static constexpr bool shifted = true;
+
+    static const char* name() { return sizeof(T) == sizeof(float) ? "shifted float" : "shifted double"; }
+
+    static real load(const T& v, const real& shift) { return real(v) + shift; }
+    static T store(const real& f, const real& shift) { return T(f - shift); }
+};
+
+#endif
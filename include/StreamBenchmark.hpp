@@ -0,0 +1,12 @@
+#ifndef STREAMBENCHMARK_HPP
+#define STREAMBENCHMARK_HPP
+
+#include <cstddef>
+
+// Memory bandwidth of the STREAM triad a[i] = b[i] + s*c[i] in GB/s (best of a few runs),
+// using all OpenMP threads. Counts 3 doubles of traffic per element, like the original
+// STREAM, i.e. without the write allocate of a. Each array has n doubles, n should make
+// the arrays well larger than the last level cache. The result is measured once and cached.
+double streamTriadBandwidth(const size_t& n = size_t(1) << 24);
+
+#endif
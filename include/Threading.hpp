@@ -0,0 +1,23 @@
+#ifndef THREADING_HPP
+#define THREADING_HPP
+
+// Helpers for the OpenMP parallelisation. Without OpenMP everything runs on one thread.
+
+#include <cstddef>
+
+// No. of threads used by the parallel loops
+int numThreads();
+
+// The contiguous part [begin, end) of n iterations the calling thread gets from an
+// "omp for schedule(static)" loop. Used where the loop has to be split by hand but the
+// threads must keep the rows they touched first in Lattice::init().
+void threadSlab(const size_t& n, size_t& begin, size_t& end);
+
+// Pins every OpenMP thread to its own CPU (compact, in the order of the CPUs the process
+// may run on), so that a thread stays next to the memory it touched first. Nothing is done
+// if the user already asked the OpenMP runtime to bind (OMP_PROC_BIND, OMP_PLACES,
+// GOMP_CPU_AFFINITY). A later call pins again if the no. of threads changed, the workers the
+// runtime adds start with the mask of the master thread.
+void pinThreads();
+
+#endif
@@ -6,6 +6,7 @@
 
 // Lets rename double as real in the assignment
 typedef double real;
+
 //typedef std::pair<std::string, size_t> Pair;
 //typedef std::map<std::string, size_t> Map;
 
@@ -24,4 +25,13 @@ typedef enum {
 
 typedef enum { scenario1 = 1, scenario2 } Scenario;
 
+// How the populations are propagated between time steps
+// twoLattice: pull from src into dest and swap the lattices
+// aaPattern : one lattice, even steps collide in place, odd steps stream in and out (AA pattern)
+// esoTwist  : one lattice, every step reads and writes the same rotated locations (Esoteric Twist)
+typedef enum { twoLattice, aaPattern, esoTwist } Propagation;
+
+// Collision operator of the time steps, see Collision.hpp
+typedef enum { bgk, trt, mrt, regularized, cumulant } CollisionModel;
+
 #endif
@@ -0,0 +1,233 @@
+#include "Checkpoint.hpp"
+#include <stdexcept>
+#include <vector>
+#include <algorithm>    // std::min
+#include <cstring>      // memcpy, memset, strerror
+#include <cerrno>
+#include <cstdio>       // rename
+#include <fcntl.h>      // open
+#include <unistd.h>     // ftruncate, fsync, close
+#include <sys/mman.h>   // mmap, msync, madvise
+#include <sys/stat.h>   // fstat
+
+// The data is copied and checksummed in chunks of this size, in parallel
+static const size_t chunkSize = size_t(4) << 20;
+
+static const uint32_t byteOrderMark = 0x01020304;
+
+
+static std::runtime_error checkpointError(const std::string& path, const std::string& what)
+{
+    return std::runtime_error("Checkpoint " + path + ": " + what);
+}
+
+static std::runtime_error systemError(const std::string& path, const std::string& call)
+{
+    return checkpointError(path, call + " failed (" + std::strerror(errno) + ")");
+}
+
+static inline uint64_t mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t checksum64(const void* data, const size_t& n, const uint64_t& seed)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const uint64_t prime = 0x9e3779b97f4a7c15ULL;
+
+    // Independent lanes, so the multiplications of consecutive words overlap
+    uint64_t lane[4] = {seed + 1, seed + 2, seed + 3, seed + 4};
+
+    size_t i = 0;
+    for(; i + 32 <= n; i += 32)
+        for(size_t l=0; l< 4; ++l){
+            uint64_t word;
+            std::memcpy(&word, p + i + 8*l, 8);
+            lane[l] = (lane[l] ^ word) * prime;
+            lane[l] ^= lane[l] >> 29;
+        }
+
+    // Remaining bytes, zero padded to whole words
+    for(size_t l=0; i< n; i += 8, ++l){
+        uint64_t word = 0;
+        std::memcpy(&word, p + i, std::min(size_t(8), n - i));
+        lane[l] = (lane[l] ^ word) * prime;
+        lane[l] ^= lane[l] >> 29;
+    }
+
+    uint64_t h = mix(n ^ seed);
+    for(size_t l=0; l< 4; ++l)
+        h = mix(h ^ lane[l]) * prime;
+
+    return mix(h);
+}
+
+// Checksum of n bytes at src, copied to dest on the way unless it is null. Every thread copies
+// and checksums whole chunks, the chunk sums are combined at the end.
+static uint64_t copyWithChecksum(void* dest, const void* src, const size_t& n)
+{
+    const size_t numChunks = (n + chunkSize - 1) / chunkSize;
+    std::vector<uint64_t> sums(numChunks);
+
+    #pragma omp parallel for schedule(static)
+    for(size_t c=0; c< numChunks; ++c){
+
+        const size_t begin = c * chunkSize;
+        const size_t length = std::min(chunkSize, n - begin);
+
+        if(dest)
+            std::memcpy(static_cast<char*>(dest) + begin, static_cast<const char*>(src) + begin, length);
+        sums[c] = checksum64(static_cast<const char*>(src) + begin, length, c);
+    }
+
+    return checksum64(sums.data(), sums.size() * sizeof(uint64_t), n);
+}
+
+static uint64_t headerChecksum(CheckpointHeader header)
+{
+    header.headerChecksum = 0;
+    return checksum64(&header, sizeof(header));
+}
+
+
+CheckpointHeader checkpointHeader()
+{
+    CheckpointHeader header;
+    std::memset(&header, 0, sizeof(header));
+
+    std::memcpy(header.magic, "LBMCKPT", 8);
+    header.version = CHECKPOINT_VERSION;
+    header.byteOrder = byteOrderMark;
+    return header;
+}
+
+void writeCheckpointFile(const std::string& path, CheckpointHeader& header, const void* data, const size_t& bytes)
+{
+    const std::string tmpPath = path + ".tmp";
+    const size_t fileSize = CHECKPOINT_HEADER_SIZE + bytes;
+
+    const int fd = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        throw systemError(tmpPath, "open");
+
+    if(::ftruncate(fd, off_t(fileSize)) != 0) {
+        ::close(fd);
+        throw systemError(tmpPath, "ftruncate");
+    }
+
+    void* map = ::mmap(0, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED) {
+        ::close(fd);
+        throw systemError(tmpPath, "mmap");
+    }
+
+    char* const file = static_cast<char*>(map);
+
+    header.dataBytes = bytes;
+    header.dataChecksum = copyWithChecksum(file + CHECKPOINT_HEADER_SIZE, data, bytes);
+    header.headerChecksum = headerChecksum(header);
+
+    // The rest of the header page stays 0 from ftruncate
+    std::memcpy(file, &header, sizeof(header));
+
+    // On the disk before the previous checkpoint is replaced
+    const bool synced = ::msync(map, fileSize, MS_SYNC) == 0;
+    ::munmap(map, fileSize);
+    ::close(fd);
+
+    if(!synced)
+        throw systemError(tmpPath, "msync");
+
+    if(::rename(tmpPath.c_str(), path.c_str()) != 0)
+        throw systemError(path, "rename");
+
+    // The rename is only durable once the directory entry is on the disk
+    const size_t slash = path.rfind('/');
+    const std::string directory = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+
+    const int dirFd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if(dirFd < 0)
+        throw systemError(path, "open of the directory " + directory);
+
+    const bool dirSynced = ::fsync(dirFd) == 0;
+    ::close(dirFd);
+
+    if(!dirSynced)
+        throw systemError(path, "fsync of the directory " + directory);
+}
+
+
+CheckpointReader::CheckpointReader(const std::string& path) : path(path), fd(-1), fileSize(0), map(0)
+{
+    fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw systemError(path, "open");
+
+    struct stat info;
+    if(::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw systemError(path, "fstat");
+    }
+
+    fileSize = size_t(info.st_size);
+    if(fileSize < CHECKPOINT_HEADER_SIZE) {
+        ::close(fd);
+        throw checkpointError(path, "too short for a checkpoint");
+    }
+
+    void* m = ::mmap(0, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(m == MAP_FAILED) {
+        ::close(fd);
+        throw systemError(path, "mmap");
+    }
+
+    // Read once from front to back
+    ::madvise(m, fileSize, MADV_SEQUENTIAL);
+    ::madvise(m, fileSize, MADV_WILLNEED);
+    map = static_cast<const char*>(m);
+
+    // Checked one after the other, so the error says why the file does not fit
+    const CheckpointHeader& h = header();
+    std::string error;
+
+    if(std::memcmp(h.magic, "LBMCKPT", 8) != 0)
+        error = "not a checkpoint file";
+    else if(h.byteOrder != byteOrderMark)
+        error = "written on a machine of another byte order";
+    else if(h.version != CHECKPOINT_VERSION)
+        error = "version " + std::to_string(h.version) + ", expected " + std::to_string(CHECKPOINT_VERSION);
+    else if(h.headerChecksum != headerChecksum(h))
+        error = "the header is corrupt (checksum mismatch)";
+    else if(h.dataBytes != fileSize - CHECKPOINT_HEADER_SIZE)
+        error = "truncated, " + std::to_string(fileSize - CHECKPOINT_HEADER_SIZE) + " of " + std::to_string(h.dataBytes) + " bytes of data";
+
+    if(!error.empty()) {
+        ::munmap(m, fileSize);
+        ::close(fd);
+        throw checkpointError(path, error);
+    }
+}
+
+CheckpointReader::~CheckpointReader()
+{
+    ::munmap(const_cast<char*>(map), fileSize);
+    ::close(fd);
+}
+
+void CheckpointReader::read(void* data, const size_t& bytes) const
+{
+    if(bytes != header().dataBytes)
+        throw checkpointError(path, std::to_string(header().dataBytes) + " bytes of data, expected " + std::to_string(bytes));
+
+    // Checked on the mapping first, a corrupt file leaves data as it is
+    if(copyWithChecksum(0, map + CHECKPOINT_HEADER_SIZE, bytes) != header().dataChecksum)
+        throw checkpointError(path, "the data is corrupt (checksum mismatch)");
+
+    std::memcpy(data, map + CHECKPOINT_HEADER_SIZE, bytes);
+}
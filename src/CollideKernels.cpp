@@ -0,0 +1,226 @@
+#include "CollideKernels.hpp"
+#include "CollideRow.hpp"
+#include "Log.hpp"
+#include <cstdlib>      // getenv, rand
+#include <cstring>      // strcmp
+#include <cmath>
+#include <vector>
+#include <limits>
+
+// Lattice velocities and weights
+static const int* const cx = Stencil::cx;
+static const int* const cy = Stencil::cy;
+static const real* const w = Stencil::w;
+
+
+CollisionRates collisionRates(const real& omega, const real& smagorinsky, const real& magic)
+{
+    CollisionRates rates;
+    rates.omega = omega;
+    rates.omegaOdd = 1.0 / (magic / (1.0/omega - 0.5) + 0.5);
+    rates.omegaBulk = 1.0;
+    rates.omegaEps = 1.0;
+    rates.magic = magic;
+    rates.smagorinsky = smagorinsky;
+    return rates;
+}
+
+const char* collisionName(const CollisionModel& model)
+{
+    switch(model) {
+        case trt:         return TRT::name();
+        case mrt:         return MRT::name();
+        case regularized: return Regularized::name();
+        case cumulant:    return Cumulant::name();
+        default:          return BGK::name();
+    }
+}
+
+
+template<typename T>
+static void collideRowReferenceT(const T* const* in, T* const* out, const size_t& n, const CollisionRates& rates, const real* shift,
+                                 const BodyForce* force)
+{
+    const real omega = rates.omega;
+
+    for(size_t i=0; i< n; ++i){
+
+        real f[Stencil::Q];
+        real rho = 0.0, ux = 0.0, uy = 0.0;
+
+        for(size_t q=0; q< Stencil::Q; ++q){
+            f[q] = shift ? real(in[q][i]) + shift[q] : real(in[q][i]);
+            rho += f[q];
+            ux += cx[q] * f[q];
+            uy += cy[q] * f[q];
+        }
+
+        // Guo forcing, F = rho a
+        real fx = 0.0, fy = 0.0;
+        if(force) {
+            fx = rho * (force->x + (force->fieldX ? force->fieldX[i] : 0.0));
+            fy = rho * (force->y + (force->fieldY ? force->fieldY[i] : 0.0));
+        }
+
+        ux = (ux + 0.5*fx) / rho;
+        uy = (uy + 0.5*fy) / rho;
+
+        const real usq = 1.5 * (ux*ux + uy*uy);
+
+        for(size_t q=0; q< Stencil::Q; ++q){
+            const real cu = 3.0 * (cx[q]*ux + cy[q]*uy);
+            const real feq = w[q] * rho * (1.0 + cu + 0.5*cu*cu - usq);
+            const real source = w[q] * (3.0 * ((cx[q] - ux)*fx + (cy[q] - uy)*fy) + 3.0 * cu * (cx[q]*fx + cy[q]*fy));
+
+            const real fOut = f[q] - omega * (f[q] - feq) + (1.0 - 0.5*omega) * source;
+            out[q][i] = T(shift ? fOut - shift[q] : fOut);
+        }
+    }
+}
+
+void collideRowReference(const double* const* in, double* const* out, const size_t& n, const CollisionRates& rates, const real* shift,
+                         const BodyForce* force)
+{
+    collideRowReferenceT(in, out, n, rates, shift, force);
+}
+
+void collideRowReference(const float* const* in, float* const* out, const size_t& n, const CollisionRates& rates, const real* shift,
+                         const BodyForce* force)
+{
+    collideRowReferenceT(in, out, n, rates, shift, force);
+}
+
+template<typename Op, typename T>
+void collideRowScalar(const T* const* in, T* const* out, const size_t& n, const CollisionRates& rates, const real* shift,
+                      const BodyForce* force)
+{
+    collideRow<VecScalar, Op>(in, out, n, rates, shift, force);
+}
+
+LBM_INSTANTIATE_COLLIDE_KERNEL(collideRowScalar)
+
+
+template<typename T>
+real verifyCollideKernel(CollideKernel<T> kernel, CollideKernel<T> reference, const CollisionRates& rates)
+{
+    // Odd no. of cells, so that the remainder loops are exercised as well
+    const size_t n = 37;
+
+    std::vector<T> in(Stencil::Q * n), outRef(Stencil::Q * n), out(Stencil::Q * n);
+    const T* inPtr[Stencil::Q];
+    T* outRefPtr[Stencil::Q];
+    T* outPtr[Stencil::Q];
+
+    // Constant and per cell acceleration
+    std::vector<real> accX(n), accY(n);
+    for(size_t i=0; i< n; ++i){
+        accX[i] = 1e-3 * std::sin(0.5 * i);
+        accY[i] = 1e-3 * std::cos(0.3 * i);
+    }
+    const BodyForce constant = {2e-3, -1e-3, 0, 0};
+    const BodyForce field = {2e-3, -1e-3, accX.data(), accY.data()};
+    const BodyForce* forces[] = {0, &constant, &field};
+
+    std::srand(42);
+    for(size_t q=0; q< Stencil::Q; ++q){
+        for(size_t i=0; i< n; ++i)
+            in[q*n + i] = T(w[q] * (1.0 + 0.2 * (real(std::rand()) / RAND_MAX - 0.5)));
+
+        inPtr[q] = &in[q*n];
+        outRefPtr[q] = &outRef[q*n];
+        outPtr[q] = &out[q*n];
+    }
+
+    // Plain and shifted storage, without and with forcing
+    real maxDev = 0.0;
+    for(int shifted=0; shifted< 2; ++shifted)
+    for(int f=0; f< 3; ++f) {
+
+        reference(inPtr, outRefPtr, n, rates, shifted ? w : 0, forces[f]);
+        kernel(inPtr, outPtr, n, rates, shifted ? w : 0, forces[f]);
+
+        for(size_t k=0; k< out.size(); ++k)
+            maxDev = std::max(maxDev, real(std::fabs(out[k] - outRef[k])));
+    }
+
+    return maxDev;
+}
+
+
+// All kernels of operator Op the CPU can execute, the widest one last
+template<typename Op, typename T>
+static std::vector<CollideKernelInfo<T> > supportedKernels()
+{
+    std::vector<CollideKernelInfo<T> > supported;
+    supported.push_back(CollideKernelInfo<T>{"scalar", collideRowScalar<Op, T>});
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse2"))
+        supported.push_back(CollideKernelInfo<T>{"sse2", collideRowSSE2<Op, T>});
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        supported.push_back(CollideKernelInfo<T>{"avx2", collideRowAVX2<Op, T>});
+    if(__builtin_cpu_supports("avx512f"))
+        supported.push_back(CollideKernelInfo<T>{"avx512", collideRowAVX512<Op, T>});
+#endif
+
+    return supported;
+}
+
+// The same with the Smagorinsky model if les is set
+template<typename Op, typename T>
+static std::vector<CollideKernelInfo<T> > supportedKernels(const bool& les)
+{
+    return les ? supportedKernels<Smagorinsky<Op>, T>() : supportedKernels<Op, T>();
+}
+
+template<typename T>
+CollideKernelInfo<T> selectCollideKernel(const CollisionModel& model, const bool& les)
+{
+    std::vector<CollideKernelInfo<T> > supported;
+    switch(model) {
+        case trt:         supported = supportedKernels<TRT, T>(les); break;
+        case mrt:         supported = supportedKernels<MRT, T>(les); break;
+        case regularized: supported = supportedKernels<Regularized, T>(les); break;
+        case cumulant:    supported = supportedKernels<Cumulant, T>(les); break;
+        default:          supported = supportedKernels<BGK, T>(les); break;
+    }
+
+    CollideKernelInfo<T> info = supported.back();
+
+    const char* requested = std::getenv("LBM_KERNEL");
+    if(requested) {
+        bool found = false;
+        for(size_t k=0; k< supported.size(); ++k)
+            if(std::strcmp(supported[k].name, requested) == 0) { info = supported[k]; found = true; }
+
+        if(!found)
+            LOG_WARNING("LBM_KERNEL=" << requested << " is not supported by this CPU, using " << info.name);
+    }
+
+    // Never run with a kernel that disagrees with the reference (beyond rounding of the storage type).
+    // BGK is checked against the textbook version, the other operators only have their scalar version.
+    // The additional rates differ from 1 here, so that every term is checked.
+    CollisionRates rates = collisionRates(1.7, 0.17);
+    rates.omegaBulk = 1.3;
+    rates.omegaEps = 1.1;
+
+    const CollideKernel<T> reference = model == bgk && !les ? CollideKernel<T>(collideRowReference) : supported.front().kernel;
+    const real deviation = verifyCollideKernel<T>(info.kernel, reference, rates);
+    if(deviation > 16 * std::numeric_limits<T>::epsilon()) {
+        LOG_WARNING("Collide kernel " << info.name << " deviates by " << deviation
+                    << " from the scalar reference, using scalar");
+        info = supported.front();
+    }
+
+    LOG_INFO("Collide kernel :" << info.name << " " << collisionName(model) << (les ? " + Smagorinsky" : "") << " on "
+             << (sizeof(T) == sizeof(float) ? "float" : "double")
+             << " (max. deviation from scalar reference " << deviation << ")");
+
+    return info;
+}
+
+template CollideKernelInfo<double> selectCollideKernel<double>(const CollisionModel&, const bool&);
+template CollideKernelInfo<float> selectCollideKernel<float>(const CollisionModel&, const bool&);
+template real verifyCollideKernel<double>(CollideKernel<double>, CollideKernel<double>, const CollisionRates&);
+template real verifyCollideKernel<float>(CollideKernel<float>, CollideKernel<float>, const CollisionRates&);
@@ -0,0 +1,16 @@
+#include "CollideKernels.hpp"
+#include "CollideRow.hpp"
+
+// Built with -mavx2 -mfma
+template<typename Op, typename T>
+void collideRowAVX2(const T* const* in, T* const* out, const size_t& n, const CollisionRates& rates, const real* shift,
+                    const BodyForce* force)
+{
+#if defined(__AVX2__) && defined(__FMA__)
+    collideRow<VecAVX2, Op>(in, out, n, rates, shift, force);
+#else
+    collideRowScalar<Op>(in, out, n, rates, shift, force);
+#endif
+}
+
+LBM_INSTANTIATE_COLLIDE_KERNEL(collideRowAVX2)
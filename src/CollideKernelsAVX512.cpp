@@ -0,0 +1,16 @@
+#include "CollideKernels.hpp"
+#include "CollideRow.hpp"
+
+// Built with -mavx512f
+template<typename Op, typename T>
+void collideRowAVX512(const T* const* in, T* const* out, const size_t& n, const CollisionRates& rates, const real* shift,
+                      const BodyForce* force)
+{
+#ifdef __AVX512F__
+    collideRow<VecAVX512, Op>(in, out, n, rates, shift, force);
+#else
+    collideRowScalar<Op>(in, out, n, rates, shift, force);
+#endif
+}
+
+LBM_INSTANTIATE_COLLIDE_KERNEL(collideRowAVX512)
@@ -0,0 +1,16 @@
+#include "CollideKernels.hpp"
+#include "CollideRow.hpp"
+
+// Built with -msse2
+template<typename Op, typename T>
+void collideRowSSE2(const T* const* in, T* const* out, const size_t& n, const CollisionRates& rates, const real* shift,
+                    const BodyForce* force)
+{
+#ifdef __SSE2__
+    collideRow<VecSSE2, Op>(in, out, n, rates, shift, force);
+#else
+    collideRowScalar<Op>(in, out, n, rates, shift, force);
+#endif
+}
+
+LBM_INSTANTIATE_COLLIDE_KERNEL(collideRowSSE2)
@@ -0,0 +1,463 @@
+#include "DistributedSimulation.hpp"
+#include "Parameters.hpp"
+#include "Threading.hpp"
+#include "Log.hpp"
+#include <utility>      // std::swap
+#include <algorithm>    // std::min
+#include <stdexcept>
+#include <string>
+
+template<typename T> static MPI_Datatype mpiType();
+template<> MPI_Datatype mpiType<double>() { return MPI_DOUBLE; }
+template<> MPI_Datatype mpiType<float>() { return MPI_FLOAT; }
+
+// Cells [offset, offset + size) of part index of n cells split into parts, the first n % parts
+// parts get one cell more
+static void split(const size_t& n, const int& parts, const int& index, size_t& offset, size_t& size)
+{
+    const size_t base = n / parts;
+    const size_t rest = n % parts;
+
+    size = base + (size_t(index) < rest);
+    offset = index * base + std::min(size_t(index), rest);
+}
+
+
+template<typename Storage>
+DistributedSimulation<Storage>::DistributedSimulation(const FlagField& flags, MPI_Comm world, const CollisionModel& model, const real& cs,
+                                                      const int& bx, const int& by){
+
+    this->globalX = flags.sizeX() - 2;
+    this->globalY = flags.sizeY() - 2;
+    this->globalFluid = flags.fluidCells();
+    this->timeStep = 0;
+    this->smagorinsky = cs;
+    this->accX = 0.0;
+    this->accY = 0.0;
+
+    MPI_Comm_size(world, &numRanks);
+
+    // One count given, the other one follows from the no. of ranks
+    int blocksX = bx, blocksY = by;
+    if(blocksX > 0 && blocksY <= 0)
+        blocksY = numRanks / blocksX;
+    else if(blocksY > 0 && blocksX <= 0)
+        blocksX = numRanks / blocksY;
+
+    // The split with the shortest halo per block, i.e. blocks as square as possible
+    if(blocksX <= 0 || blocksY <= 0) {
+        double best = 0.0;
+        for(int px=1; px<= numRanks; ++px){
+            const int py = numRanks / px;
+            if(px * py != numRanks || size_t(px) > globalX || size_t(py) > globalY)
+                continue;
+
+            const double halo = double(globalX) / px + double(globalY) / py;
+            if(best == 0.0 || halo < best) {
+                best = halo;
+                blocksX = px;
+                blocksY = py;
+            }
+        }
+    }
+
+    if(blocksX * blocksY != numRanks || size_t(blocksX) > globalX || size_t(blocksY) > globalY)
+        throw std::invalid_argument("Can't split " + std::to_string(globalX) + " x " + std::to_string(globalY) + " cells into " +
+                                    std::to_string(blocksX) + " x " + std::to_string(blocksY) + " blocks for " +
+                                    std::to_string(numRanks) + " ranks");
+
+    // The halo indices are 32 bit, the first block of a row / column is the largest. The same
+    // on every rank, so all of them throw
+    const size_t largest = (globalX / blocksX + (globalX % blocksX != 0) + 2) * (globalY / blocksY + (globalY % blocksY != 0) + 2);
+    if(Stencil::Q * largest >= size_t(uint32_t(-1)))
+        throw std::invalid_argument("Can't address the blocks of " + std::to_string(largest) + " cells with 32 bit indices, split " +
+                                    std::to_string(globalX) + " x " + std::to_string(globalY) + " cells into more blocks");
+
+    blocks[0] = blocksX;
+    blocks[1] = blocksY;
+
+    // Periodic in x, the ranks may be reordered to fit the machine
+    int periods[2] = {1, 0};
+    MPI_Cart_create(world, 2, blocks, periods, 1, &comm);
+    MPI_Comm_rank(comm, &rank_);
+    MPI_Cart_coords(comm, rank_, 2, coords);
+
+    size_t sizeX, sizeY;
+    split(globalX, blocks[0], coords[0], offsetX, sizeX);
+    split(globalY, blocks[1], coords[1], offsetY, sizeY);
+
+    this->numCellsX = sizeX + 2;
+    this->numCellsY = sizeY + 2;
+    this->numCells = numCellsX * numCellsY;
+
+    LOG_INFO("=============  Distributed lattice =========  ");
+    LOG_INFO("Ranks :" << numRanks << " (" << blocks[0] << " x " << blocks[1] << " blocks)");
+    LOG_INFO("Threads per rank :" << numThreads());
+    LOG_DEBUG("Block of rank " << rank_ << " :" << sizeX << " x " << sizeY << " cells from (" << offsetX + 1 << ", " << offsetY + 1 << ")");
+
+    // No pinning here: the ranks on a socket would pin their threads to the same CPUs, the
+    // placement is left to mpirun (--bind-to, --map-by)
+
+    // Obstacles of the block, the ghost columns beyond the ends of the domain are the periodic
+    // images, the ghost rows beyond its ends the walls
+    obstacle.resize(numCells);
+    for(size_t j=0; j< numCellsY; ++j)
+        for(size_t i=0; i< numCellsX; ++i)
+            obstacle[cell(i, j)] = flags.isObstacle(flags.periodicX(offsetX + i), offsetY + j);
+
+    // Rest equilibrium, first touch by the threads sweeping the rows
+    src.resize(Stencil::Q * numCells);
+    dest.resize(Stencil::Q * numCells);
+
+    #pragma omp parallel for schedule(static)
+    for(size_t j=0; j< numCellsY; ++j)
+        for(size_t q=0; q< Stencil::Q; ++q)
+            for(size_t c=j*numCellsX; c< (j + 1)*numCellsX; ++c){
+                src[q*numCells + c] = Storage::store(Stencil::w[q], Stencil::w[q]);
+                dest[q*numCells + c] = Storage::store(Stencil::w[q], Stencil::w[q]);
+            }
+
+    // Bounce back links of the fluid cells
+    for(size_t j=1; j< numCellsY - 1; ++j)
+        for(size_t i=1; i< numCellsX - 1; ++i){
+
+            if(obstacle[cell(i, j)])
+                continue;
+
+            for(size_t q=1; q< Stencil::Q; ++q){
+
+                const size_t iFrom = i - Stencil::cx[q];
+                const size_t jFrom = j - Stencil::cy[q];
+
+                if(!obstacle[cell(iFrom, jFrom)])
+                    continue;
+
+                const Link link = {uint32_t(cell(i, j)), uint32_t(q)};
+                const bool ghost = iFrom == 0 || iFrom == numCellsX - 1 || jFrom == 0 || jFrom == numCellsY - 1;
+                (ghost ? ghostLinks : interiorLinks).push_back(link);
+            }
+        }
+
+    buildHalos();
+
+    this->collideKernel = selectCollideKernel<value_type>(model, smagorinsky > 0);
+}
+
+template<typename Storage>
+DistributedSimulation<Storage>::~DistributedSimulation(){
+
+    MPI_Comm_free(&comm);
+}
+
+template<typename Storage>
+void DistributedSimulation<Storage>::buildHalos(){
+
+    // Rank of the block at (dx, dy) from this one, MPI_PROC_NULL beyond the walls
+    auto neighbour = [this](const int& dx, const int& dy) {
+        int c[2] = {(coords[0] + dx + blocks[0]) % blocks[0], coords[1] + dy};
+        if(c[1] < 0 || c[1] >= blocks[1])
+            return int(MPI_PROC_NULL);
+
+        int r;
+        MPI_Cart_rank(comm, c, &r);
+        return r;
+    };
+
+    // Cells [begin, end) along one axis: the last (first) non ghost one for d = 1 (-1),
+    // all non ghost ones for d = 0. The ghost cells on the other side receive them.
+    auto sendRange = [](const int& d, const size_t& n, size_t& begin, size_t& end) {
+        begin = d > 0 ? n - 2 : 1;
+        end = d < 0 ? 2 : n - 1;
+    };
+    auto recvRange = [](const int& d, const size_t& n, size_t& begin, size_t& end) {
+        begin = d > 0 ? 0 : (d < 0 ? n - 1 : 1);
+        end = d > 0 ? 1 : (d < 0 ? n : n - 1);
+    };
+
+    // The neighbour directions are those of the lattice velocities 1 ... 8
+    for(size_t d=0; d< 8; ++d){
+
+        const int dx = Stencil::cx[d + 1];
+        const int dy = Stencil::cy[d + 1];
+        Halo& halo = halos[d];
+
+        halo.sendRank = neighbour(dx, dy);
+        halo.recvRank = neighbour(-dx, -dy);
+
+        size_t iBegin, iEnd, jBegin, jEnd;
+
+        // f_q's crossing the face (or corner): 3 for a face, 1 for a corner
+        if(halo.sendRank != MPI_PROC_NULL) {
+            sendRange(dx, numCellsX, iBegin, iEnd);
+            sendRange(dy, numCellsY, jBegin, jEnd);
+            for(size_t j=jBegin; j< jEnd; ++j)
+                for(size_t i=iBegin; i< iEnd; ++i)
+                    for(size_t q=1; q< Stencil::Q; ++q)
+                        if((dx == 0 || Stencil::cx[q] == dx) && (dy == 0 || Stencil::cy[q] == dy))
+                            halo.sendIndex.push_back(uint32_t(q*numCells + cell(i, j)));
+        }
+
+        if(halo.recvRank != MPI_PROC_NULL) {
+            recvRange(dx, numCellsX, iBegin, iEnd);
+            recvRange(dy, numCellsY, jBegin, jEnd);
+            for(size_t j=jBegin; j< jEnd; ++j)
+                for(size_t i=iBegin; i< iEnd; ++i)
+                    for(size_t q=1; q< Stencil::Q; ++q)
+                        if((dx == 0 || Stencil::cx[q] == dx) && (dy == 0 || Stencil::cy[q] == dy))
+                            halo.recvIndex.push_back(uint32_t(q*numCells + cell(i, j)));
+        }
+
+        halo.sendBuffer.resize(halo.sendIndex.size());
+        halo.recvBuffer.resize(halo.recvIndex.size());
+    }
+}
+
+template<typename Storage>
+void DistributedSimulation<Storage>::setAcceleration(const real& ax, const real& ay){
+
+    this->accX = ax;
+    this->accY = ay;
+    LOG_INFO("Body acceleration :(" << ax << ", " << ay << ")");
+}
+
+template<typename Storage>
+void DistributedSimulation<Storage>::startExchange(){
+
+    const MPI_Datatype type = mpiType<value_type>();
+
+    for(size_t d=0; d< 8; ++d){
+        Halo& halo = halos[d];
+        MPI_Irecv(halo.recvBuffer.data(), int(halo.recvBuffer.size()), type, halo.recvRank, int(d), comm, &requests[d]);
+    }
+
+    for(size_t d=0; d< 8; ++d){
+        Halo& halo = halos[d];
+        for(size_t k=0; k< halo.sendIndex.size(); ++k)
+            halo.sendBuffer[k] = src[halo.sendIndex[k]];
+
+        MPI_Isend(halo.sendBuffer.data(), int(halo.sendBuffer.size()), type, halo.sendRank, int(d), comm, &requests[8 + d]);
+    }
+}
+
+template<typename Storage>
+void DistributedSimulation<Storage>::finishExchange(){
+
+    MPI_Waitall(8, requests, MPI_STATUSES_IGNORE);
+
+    for(size_t d=0; d< 8; ++d){
+        const Halo& halo = halos[d];
+        for(size_t k=0; k< halo.recvIndex.size(); ++k)
+            src[halo.recvIndex[k]] = halo.recvBuffer[k];
+    }
+
+    // The ghost cells that are obstacles got whatever the neighbour had there
+    bounceBack(ghostLinks);
+}
+
+template<typename Storage>
+void DistributedSimulation<Storage>::bounceBack(const std::vector<Link>& links){
+
+    // The stored values are copied as they are, fine for shifted storage since w_q == w_opposite(q)
+    #pragma omp parallel for schedule(static)
+    for(size_t l=0; l< links.size(); ++l){
+
+        const size_t c = links[l].cell;
+        const size_t q = links[l].q;
+        const size_t from = c - Stencil::cx[q] - Stencil::cy[q] * std::ptrdiff_t(numCellsX);
+
+        src[q*numCells + from] = src[Stencil::opposite[q]*numCells + c];
+    }
+}
+
+template<typename Storage>
+void DistributedSimulation<Storage>::sweep(const size_t& jBegin, const size_t& jEnd, const size_t& iBegin, const size_t& iEnd){
+
+    const CollisionRates rates = collisionRates(relaxRate, smagorinsky);
+    const real* shift = Storage::shifted ? Stencil::w : nullptr;
+    const BodyForce force = {accX, accY, 0, 0};
+    const BodyForce* forced = (accX != 0.0 || accY != 0.0) ? &force : nullptr;
+
+    #pragma omp parallel for schedule(static)
+    for(size_t j=jBegin; j< jEnd; ++j){
+
+        size_t i = iBegin;
+        while(i < iEnd){
+
+            // Next run of fluid cells
+            while(i < iEnd && obstacle[cell(i, j)])
+                ++i;
+            size_t end = i;
+            while(end < iEnd && !obstacle[cell(end, j)])
+                ++end;
+
+            if(end > i) {
+                // SoA: the f_q's pulled by the run are a row of direction q as well
+                const value_type* in[Stencil::Q];
+                value_type* out[Stencil::Q];
+
+                for(size_t q=0; q< Stencil::Q; ++q){
+                    const size_t from = cell(i, j) - Stencil::cx[q] - Stencil::cy[q] * std::ptrdiff_t(numCellsX);
+                    in[q] = src.data() + q*numCells + from;
+                    out[q] = dest.data() + q*numCells + cell(i, j);
+                }
+
+                collideKernel.kernel(in, out, end - i, rates, shift, forced);
+            }
+
+            i = end;
+        }
+    }
+}
+
+template<typename Storage>
+void DistributedSimulation<Storage>::stream_Collide(){
+
+    const size_t lastX = numCellsX - 2;
+    const size_t lastY = numCellsY - 2;
+
+    startExchange();
+
+    // Interior, overlapping the exchange
+    bounceBack(interiorLinks);
+    if(lastX > 2 && lastY > 2)
+        sweep(2, lastY, 2, lastX);
+
+    finishExchange();
+
+    // Cells along the edges: first and last row, first and last column in between
+    sweep(1, 2, 1, lastX + 1);
+    if(lastY > 1)
+        sweep(lastY, lastY + 1, 1, lastX + 1);
+    if(lastY > 2) {
+        sweep(2, lastY, 1, 2);
+        if(lastX > 1)
+            sweep(2, lastY, lastX, lastX + 1);
+    }
+
+    MPI_Waitall(8, requests + 8, MPI_STATUSES_IGNORE);
+
+    std::swap(src, dest);
+    ++timeStep;
+}
+
+template<typename Storage>
+void DistributedSimulation<Storage>::advance(const size_t& steps){
+
+    for(size_t t=0; t< steps; ++t)
+        stream_Collide();
+}
+
+template<typename Storage>
+double DistributedSimulation<Storage>::bytesPerCellUpdate() const{
+
+    // Read src, write dest plus the write allocate of dest
+    return 3.0 * Stencil::Q * sizeof(value_type);
+}
+
+template<typename Storage>
+void DistributedSimulation<Storage>::runSimulation(){
+
+    MPI_Barrier(comm);
+    const double start = MPI_Wtime();
+
+    advance(timeSteps);
+
+    // Until the slowest rank is done
+    MPI_Barrier(comm);
+    const double elapsed = MPI_Wtime() - start;
+
+    // Million lattice (fluid cell) updates per second of all ranks
+    const double cellUpdates = double(globalFluid) * double(timeSteps);
+    const std::string tag = std::string("distributed, ") + Storage::name() + ", " + std::to_string(numRanks) + " ranks";
+
+    LOG_INFO("Runtime (" << tag << ") :" << elapsed << " s");
+    LOG_INFO("MLUPS (" << tag << ") :" << cellUpdates / elapsed * 1e-6);
+    LOG_INFO("Bandwidth (" << tag << ") :" << cellUpdates * bytesPerCellUpdate() / elapsed * 1e-9 << " GB/s");
+}
+
+template<typename Storage>
+void DistributedSimulation<Storage>::macroscopicFields(FieldSnapshot& snapshot){
+
+    // The f_q's the next collision pulls, as in Simulation, so the ghost layer is filled first
+    startExchange();
+    bounceBack(interiorLinks);
+    finishExchange();
+    MPI_Waitall(8, requests + 8, MPI_STATUSES_IGNORE);
+
+    // Density, velocity and the fluid flag of the block, one after another
+    const size_t sizeX = numCellsX - 2;
+    const size_t sizeY = numCellsY - 2;
+    const size_t n = sizeX * sizeY;
+    std::vector<float> local(4 * n, 0.0f);
+
+    #pragma omp parallel for schedule(static)
+    for(size_t j=1; j< numCellsY - 1; ++j)
+        for(size_t i=1; i< numCellsX - 1; ++i){
+
+            if(obstacle[cell(i, j)])
+                continue;
+
+            real rho = 0.0, ux = 0.0, uy = 0.0;
+            for(size_t q=0; q< Stencil::Q; ++q){
+                const size_t from = cell(i, j) - Stencil::cx[q] - Stencil::cy[q] * std::ptrdiff_t(numCellsX);
+                const real f = Storage::load(src[q*numCells + from], Stencil::w[q]);
+                rho += f;
+                ux += Stencil::cx[q] * f;
+                uy += Stencil::cy[q] * f;
+            }
+
+            const size_t k = (j-1)*sizeX + (i-1);
+            local[k] = float(rho);
+            local[n + k] = float(ux / rho + 0.5 * accX);
+            local[2*n + k] = float(uy / rho + 0.5 * accY);
+            local[3*n + k] = 1.0f;
+        }
+
+    // Position of every block, then the blocks themselves
+    const int block[4] = {int(offsetX), int(offsetY), int(sizeX), int(sizeY)};
+    std::vector<int> allBlocks(rank_ == 0 ? 4 * numRanks : 0);
+    MPI_Gather(block, 4, MPI_INT, allBlocks.data(), 4, MPI_INT, 0, comm);
+
+    std::vector<int> counts, displs;
+    std::vector<float> all;
+    if(rank_ == 0) {
+        counts.resize(numRanks);
+        displs.resize(numRanks);
+        for(int r=0; r< numRanks; ++r){
+            counts[r] = 4 * allBlocks[4*r + 2] * allBlocks[4*r + 3];
+            displs[r] = r > 0 ? displs[r-1] + counts[r-1] : 0;
+        }
+        all.resize(displs[numRanks - 1] + counts[numRanks - 1]);
+    }
+
+    MPI_Gatherv(local.data(), int(local.size()), MPI_FLOAT, all.data(), counts.data(), displs.data(), MPI_FLOAT, 0, comm);
+
+    if(rank_ != 0)
+        return;
+
+    snapshot.resize(globalX, globalY);
+    snapshot.timeStep = timeStep;
+
+    for(int r=0; r< numRanks; ++r){
+
+        const size_t ox = allBlocks[4*r], oy = allBlocks[4*r + 1];
+        const size_t bx = allBlocks[4*r + 2], by = allBlocks[4*r + 3];
+        const float* b = all.data() + displs[r];
+
+        for(size_t j=0; j< by; ++j)
+            for(size_t i=0; i< bx; ++i){
+                const size_t k = j*bx + i;
+                const size_t g = (oy + j)*globalX + ox + i;
+                snapshot.density[g] = b[k];
+                snapshot.velocity[3*g] = b[bx*by + k];
+                snapshot.velocity[3*g + 1] = b[2*bx*by + k];
+                snapshot.velocity[3*g + 2] = 0.0f;
+                snapshot.fluid[g] = b[3*bx*by + k] != 0.0f;
+            }
+    }
+}
+
+// The storage types the distributed lattice is built for
+template class DistributedSimulation<PlainStorage<double> >;
+template class DistributedSimulation<PlainStorage<float> >;
+template class DistributedSimulation<ShiftedStorage<float> >;
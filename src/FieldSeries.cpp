@@ -0,0 +1,384 @@
+#include "FieldSeries.hpp"
+#include "Checkpoint.hpp"   // checksum64
+#include "Log.hpp"
+#include "imageClass/lodepng.h"
+#include <stdexcept>
+#include <sstream>
+#include <algorithm>    // std::max
+#include <cmath>        // floor, ldexp, ilogb
+#include <cstring>      // memcpy, memset, memcmp
+#include <unistd.h>     // truncate
+
+static const uint32_t byteOrderMark = 0x01020304;
+
+// Fields of a frame: density, u_x, u_y
+static const size_t numFields = 3;
+static const char* const fieldNames[numFields] = {"density", "u_x", "u_y"};
+
+
+static std::runtime_error seriesError(const std::string& path, const std::string& what)
+{
+    return std::runtime_error("Series " + path + ": " + what);
+}
+
+template<typename Header>
+static uint64_t headerChecksum(Header header)
+{
+    header.headerChecksum = 0;
+    return checksum64(&header, sizeof(header));
+}
+
+// Deflate settings: the planes of zeros need no large window, lazy matching costs more than
+// it gains on them
+static LodePNGCompressSettings compressSettings()
+{
+    LodePNGCompressSettings settings = lodepng_default_compress_settings;
+    settings.windowsize = 1024;
+    settings.lazymatching = 0;
+    return settings;
+}
+
+static inline uint32_t zigzag(const uint32_t& d)
+{
+    const int32_t s = int32_t(d);
+    return (uint32_t(s) << 1) ^ uint32_t(s >> 31);
+}
+
+static inline uint32_t unzigzag(const uint32_t& z)
+{
+    return (z >> 1) ^ (0U - (z & 1U));
+}
+
+// Nearest multiple of step, in units of step. False for a NaN and for values beyond the range
+// of int32_t, i.e. if the error bound is too small for them. With the power of two steps the
+// multiple is a float again, see steps.
+static inline bool quantize(const float& v, const real& step, int32_t& q)
+{
+    const double s = std::floor(double(v) / step + 0.5);
+    if(!(s >= -2147483648.0 && s <= 2147483647.0))
+        return false;
+
+    q = int32_t(s);
+    return true;
+}
+
+// Quantization steps of the fields, the largest power of two up to twice their error bound.
+// Any other step would round the multiples once more when they are converted to float, by up
+// to half an ulp beyond the bound. A power of two multiple of at most 24 bits is a float, and
+// a value needing more bits is a multiple of the step itself, so the reader gets the quantized
+// value exactly.
+static inline real powerOfTwoStep(const real& error)
+{
+    return std::ldexp(real(1), std::ilogb(2.0 * error));
+}
+
+static void steps(const SeriesHeader& header, real step[numFields])
+{
+    step[0] = powerOfTwoStep(header.densityError);
+    step[1] = powerOfTwoStep(header.velocityError);
+    step[2] = powerOfTwoStep(header.velocityError);
+}
+
+
+SeriesWriter::SeriesWriter(const std::string& path, const FieldSnapshot& snapshot, const SeriesSettings& settings, const size_t& firstStep)
+    : path(path), sinceKeyframe(0), numFrames(0), rawBytes(0), storedBytes(0)
+{
+    if(!(settings.densityError > 0.0) || !(settings.velocityError > 0.0))
+        throw seriesError(path, "the error bounds must be positive");
+
+    const size_t numCells = snapshot.sizeX * snapshot.sizeY;
+
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "LBMSERS", 8);
+    header.version = SERIES_VERSION;
+    header.byteOrder = byteOrderMark;
+    header.sizeX = snapshot.sizeX;
+    header.sizeY = snapshot.sizeY;
+    header.spacing = snapshot.spacing;
+    header.densityError = settings.densityError;
+    header.velocityError = settings.velocityError;
+    header.keyframeInterval = std::max(size_t(1), settings.keyframeInterval);
+    header.maskChecksum = checksum64(snapshot.fluid.data(), numCells);
+
+    // Bounds too small for the values are rejected before the file is touched
+    values.resize(numFields * numCells);
+    quantizeFields(snapshot);
+
+    const bool exists = std::ifstream(path.c_str()).good();
+
+    if(exists) {
+        // Continue the series if it fits, after the last complete frame before firstStep
+        SeriesReader reader(path);
+        const SeriesHeader& h = reader.header();
+
+        if(h.sizeX != header.sizeX || h.sizeY != header.sizeY || h.spacing != header.spacing)
+            throw seriesError(path, "frames of " + std::to_string(h.sizeX) + " x " + std::to_string(h.sizeY) + " cells (spacing " +
+                              std::to_string(h.spacing) + "), the snapshots have " + std::to_string(header.sizeX) + " x " +
+                              std::to_string(header.sizeY) + " (spacing " + std::to_string(header.spacing) + ")");
+        if(h.maskChecksum != header.maskChecksum)
+            throw seriesError(path, "written for another geometry");
+        if(h.densityError != header.densityError || h.velocityError != header.velocityError)
+            throw seriesError(path, "written with other error bounds");
+
+        while(reader.skip(firstStep))
+            ;
+
+        const size_t kept = reader.framesRead();
+        const uint64_t keptEnd = reader.endOfFrames();
+
+        while(reader.skip())
+            ;
+
+        if(::truncate(path.c_str(), off_t(keptEnd)) != 0)
+            throw seriesError(path, "can't drop the frames after the ones kept");
+
+        header = h;
+        file.open(path.c_str(), std::ios::binary | std::ios::app);
+        LOG_INFO("Series :appending to " << path << " after " << kept << " frames");
+        if(reader.framesRead() > kept)
+            LOG_INFO("Series :dropped the " << reader.framesRead() - kept << " frames from time step " << firstStep << " on");
+    }
+    else {
+        std::vector<unsigned char> mask;
+        if(lodepng::compress(mask, snapshot.fluid.data(), numCells, compressSettings()) != 0)
+            throw seriesError(path, "can't compress the fluid flags");
+
+        header.maskBytes = mask.size();
+        header.headerChecksum = headerChecksum(header);
+
+        file.open(path.c_str(), std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(mask.data()), std::streamsize(mask.size()));
+        storedBytes += sizeof(header) + mask.size();
+    }
+
+    if(!file)
+        throw seriesError(path, "can't be written");
+
+    planes.resize(sizeof(int32_t) * values.size());
+
+    // The first frame of the writer is a key frame, also if it continues a series
+    sinceKeyframe = header.keyframeInterval;
+}
+
+SeriesWriter::~SeriesWriter()
+{
+    if(numFrames > 0)
+        LOG_INFO("Series " << path << " :" << numFrames << " frames, " << storedBytes * 1e-6 << " MB for " << rawBytes * 1e-6
+                 << " MB of floats (ratio " << double(rawBytes) / double(storedBytes) << ")");
+}
+
+void SeriesWriter::quantizeFields(const FieldSnapshot& snapshot)
+{
+    const size_t numCells = header.sizeX * header.sizeY;
+
+    real step[numFields];
+    steps(header, step);
+
+    for(size_t f=0; f< numFields; ++f){
+        int32_t* quantized = values.data() + f*numCells;
+
+        for(size_t c=0; c< numCells; ++c){
+            const float v = f == 0 ? snapshot.density[c] : snapshot.velocity[3*c + f - 1];
+            if(quantize(v, step[f], quantized[c]))
+                continue;
+
+            std::ostringstream what;
+            what << "the " << fieldNames[f] << " of cell " << c << " at time step " << snapshot.timeStep;
+            if(v != v)
+                what << " is not a number";
+            else
+                what << " is " << v << ", too large for the error bound " << (f == 0 ? header.densityError : header.velocityError)
+                     << " (it needs at least |value| / 2^31)";
+
+            throw seriesError(path, what.str());
+        }
+    }
+}
+
+void SeriesWriter::append(const FieldSnapshot& snapshot)
+{
+    const size_t numCells = header.sizeX * header.sizeY;
+
+    if(snapshot.sizeX != header.sizeX || snapshot.sizeY != header.sizeY || snapshot.spacing != header.spacing)
+        throw seriesError(path, "the snapshot of time step " + std::to_string(snapshot.timeStep) + " has another size");
+
+    quantizeFields(snapshot);
+
+    const bool keyframe = sinceKeyframe >= header.keyframeInterval;
+    sinceKeyframe = keyframe ? 1 : sinceKeyframe + 1;
+
+    // Differences (modulo 2^32, so they are exact whatever the values), zigzag coded so small
+    // negative ones are small as well, split into byte planes
+    const size_t n = values.size();
+    for(size_t k=0; k< n; ++k){
+        const uint32_t d = keyframe ? uint32_t(values[k]) : uint32_t(values[k]) - uint32_t(previous[k]);
+        const uint32_t z = zigzag(d);
+        for(size_t b=0; b< sizeof(uint32_t); ++b)
+            planes[b*n + k] = static_cast<unsigned char>(z >> (8*b));
+    }
+
+    previous.swap(values);
+    values.resize(n);
+
+    compressed.clear();
+    if(lodepng::compress(compressed, planes, compressSettings()) != 0)
+        throw seriesError(path, "can't compress the frame of time step " + std::to_string(snapshot.timeStep));
+
+    SeriesFrameHeader frame;
+    std::memset(&frame, 0, sizeof(frame));
+    std::memcpy(frame.magic, "FRM", 4);
+    frame.keyframe = keyframe;
+    frame.timeStep = snapshot.timeStep;
+    frame.dataBytes = compressed.size();
+    frame.dataChecksum = checksum64(compressed.data(), compressed.size());
+    frame.headerChecksum = headerChecksum(frame);
+
+    // Every frame is handed to the system as a whole, a crash cuts off the last one at most
+    file.write(reinterpret_cast<const char*>(&frame), sizeof(frame));
+    file.write(reinterpret_cast<const char*>(compressed.data()), std::streamsize(compressed.size()));
+    file.flush();
+
+    if(!file)
+        throw seriesError(path, "can't write the frame of time step " + std::to_string(snapshot.timeStep));
+
+    ++numFrames;
+    rawBytes += numFields * numCells * sizeof(float);
+    storedBytes += sizeof(frame) + compressed.size();
+}
+
+
+SeriesReader::SeriesReader(const std::string& path) : path(path), numFrames(0), end(0)
+{
+    file.open(path.c_str(), std::ios::binary);
+    if(!file)
+        throw seriesError(path, "can't be opened");
+
+    std::memset(&header_, 0, sizeof(header_));
+    file.read(reinterpret_cast<char*>(&header_), sizeof(header_));
+
+    // Checked one after the other, so the error says why the file does not fit
+    std::string error;
+
+    if(!file || std::memcmp(header_.magic, "LBMSERS", 8) != 0)
+        error = "not a series file";
+    else if(header_.byteOrder != byteOrderMark)
+        error = "written on a machine of another byte order";
+    else if(header_.version != SERIES_VERSION)
+        error = "version " + std::to_string(header_.version) + ", expected " + std::to_string(SERIES_VERSION);
+    else if(header_.headerChecksum != headerChecksum(header_))
+        error = "the header is corrupt (checksum mismatch)";
+
+    if(!error.empty())
+        throw seriesError(path, error);
+
+    const size_t numCells = header_.sizeX * header_.sizeY;
+
+    compressed.resize(header_.maskBytes);
+    file.read(reinterpret_cast<char*>(compressed.data()), std::streamsize(compressed.size()));
+
+    fluid.clear();
+    if(!file || lodepng::decompress(fluid, compressed) != 0 || fluid.size() != numCells ||
+       checksum64(fluid.data(), numCells) != header_.maskChecksum)
+        throw seriesError(path, "the fluid flags are corrupt");
+
+    end = sizeof(header_) + header_.maskBytes;
+}
+
+bool SeriesReader::nextHeader(SeriesFrameHeader& frame)
+{
+    file.clear();
+    file.seekg(std::streamoff(end));
+    file.read(reinterpret_cast<char*>(&frame), sizeof(frame));
+
+    const size_t got = size_t(file.gcount());
+    if(got == 0)
+        return false;
+
+    if(got < sizeof(frame)) {
+        LOG_WARNING("Series " << path << " :frame " << numFrames << " is cut off, the series ends before it");
+        return false;
+    }
+
+    if(std::memcmp(frame.magic, "FRM", 4) != 0 || frame.headerChecksum != headerChecksum(frame))
+        throw seriesError(path, "frame " + std::to_string(numFrames) + " is corrupt (header checksum mismatch)");
+
+    return true;
+}
+
+bool SeriesReader::skip(const uint64_t& before)
+{
+    SeriesFrameHeader frame;
+    if(!nextHeader(frame) || frame.timeStep >= before)
+        return false;
+
+    // Complete if its last byte is there
+    file.seekg(std::streamoff(frame.dataBytes) - 1, std::ios::cur);
+    file.get();
+    if(!file) {
+        LOG_WARNING("Series " << path << " :frame " << numFrames << " is cut off, the series ends before it");
+        return false;
+    }
+
+    end += sizeof(frame) + frame.dataBytes;
+    ++numFrames;
+    return true;
+}
+
+bool SeriesReader::next(FieldSnapshot& snapshot)
+{
+    SeriesFrameHeader frame;
+    if(!nextHeader(frame))
+        return false;
+
+    compressed.resize(frame.dataBytes);
+    file.read(reinterpret_cast<char*>(compressed.data()), std::streamsize(compressed.size()));
+
+    if(size_t(file.gcount()) < compressed.size()) {
+        LOG_WARNING("Series " << path << " :frame " << numFrames << " is cut off, the series ends before it");
+        return false;
+    }
+
+    if(checksum64(compressed.data(), compressed.size()) != frame.dataChecksum)
+        throw seriesError(path, "frame " + std::to_string(numFrames) + " is corrupt (checksum mismatch)");
+
+    const size_t numCells = header_.sizeX * header_.sizeY;
+    const size_t n = numFields * numCells;
+
+    planes.clear();
+    if(lodepng::decompress(planes, compressed) != 0 || planes.size() != sizeof(int32_t) * n)
+        throw seriesError(path, "frame " + std::to_string(numFrames) + " can't be decompressed");
+
+    if(!frame.keyframe && previous.size() != n)
+        throw seriesError(path, "frame " + std::to_string(numFrames) + " refers to a frame before it, the series starts with it");
+
+    previous.resize(n);
+    for(size_t k=0; k< n; ++k){
+        uint32_t z = 0;
+        for(size_t b=0; b< sizeof(uint32_t); ++b)
+            z |= uint32_t(planes[b*n + k]) << (8*b);
+
+        const uint32_t d = unzigzag(z);
+        previous[k] = int32_t(frame.keyframe ? d : uint32_t(previous[k]) + d);
+    }
+
+    real step[numFields];
+    steps(header_, step);
+
+    snapshot.resize(header_.sizeX, header_.sizeY, header_.spacing);
+    snapshot.timeStep = frame.timeStep;
+
+    for(size_t c=0; c< numCells; ++c){
+        snapshot.density[c] = float(previous[c] * step[0]);
+        snapshot.velocity[3*c] = float(previous[numCells + c] * step[1]);
+        snapshot.velocity[3*c + 1] = float(previous[2*numCells + c] * step[2]);
+        snapshot.velocity[3*c + 2] = 0.0f;
+        snapshot.fluid[c] = fluid[c];
+    }
+
+    snapshot.computeVorticity();
+
+    end += sizeof(frame) + frame.dataBytes;
+    ++numFrames;
+    return true;
+}
@@ -0,0 +1,356 @@
+#include "FieldWriter.hpp"
+#include "FieldSeries.hpp"
+#include "Log.hpp"
+#include "imageClass/GrayScaleImage.h"
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cmath>        // sqrt, fabs
+#include <algorithm>    // std::min, std::max
+#include <stdexcept>
+#include <cstdio>       // snprintf
+
+
+void FieldSnapshot::resize(const size_t& nX, const size_t& nY, const size_t& cells)
+{
+    sizeX = nX;
+    sizeY = nY;
+    spacing = cells;
+
+    density.resize(nX * nY);
+    velocity.resize(3 * nX * nY);
+    vorticity.resize(nX * nY);
+    fluid.resize(nX * nY);
+}
+
+void FieldSnapshot::computeVorticity()
+{
+    for(size_t j=0; j< sizeY; ++j)
+        for(size_t i=0; i< sizeX; ++i){
+
+            const size_t cell = j*sizeX + i;
+            vorticity[cell] = 0.0f;
+
+            if(!fluid[cell])
+                continue;
+
+            // Neighbours, the cell itself if the neighbour is no fluid cell
+            const size_t west = j*sizeX + (i == 0 ? sizeX - 1 : i - 1);
+            const size_t east = j*sizeX + (i == sizeX - 1 ? 0 : i + 1);
+            const size_t south = j == 0 ? cell : cell - sizeX;
+            const size_t north = j == sizeY - 1 ? cell : cell + sizeX;
+
+            const size_t w = fluid[west] ? west : cell;
+            const size_t e = fluid[east] ? east : cell;
+            const size_t s = fluid[south] ? south : cell;
+            const size_t n = fluid[north] ? north : cell;
+
+            float duydx = 0.0f, duxdy = 0.0f;
+            if(w != e)
+                duydx = (velocity[3*e + 1] - velocity[3*w + 1]) / float(spacing * ((w != cell) + (e != cell)));
+            if(s != n)
+                duxdy = (velocity[3*n] - velocity[3*s]) / float(spacing * ((s != cell) + (n != cell)));
+
+            vorticity[cell] = duydx - duxdy;
+        }
+}
+
+
+static bool littleEndian()
+{
+    const uint16_t one = 1;
+    return *reinterpret_cast<const uint8_t*>(&one) == 1;
+}
+
+template<typename T>
+static void writeBinary(std::ofstream& out, const T* data, const size_t& n)
+{
+    out.write(reinterpret_cast<const char*>(data), std::streamsize(n * sizeof(T)));
+}
+
+
+FieldWriter::FieldWriter(const std::string& prefix, const unsigned& formats, const ImageField& field, const real& range,
+                         const SeriesSettings& settings)
+    : prefix(prefix), formats(formats), imageField(field), imageRange(range), seriesSettings(settings), seriesFirstStep(0), next(0), writing(0), numWritten(0), waited(0.0), stop(false)
+{
+    for(size_t b=0; b< numBuffers; ++b)
+        pending[b] = false;
+
+    writer = std::thread(&FieldWriter::run, this);
+}
+
+FieldWriter::~FieldWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    changed.notify_all();
+    writer.join();
+}
+
+void FieldWriter::continueAfter(const size_t& timeStep)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    seriesFirstStep = timeStep + 1;
+}
+
+FieldSnapshot& FieldWriter::acquire()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if(pending[next]) {
+        const auto start = std::chrono::steady_clock::now();
+        changed.wait(lock, [this]{ return !pending[next]; });
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        waited += elapsed.count();
+    }
+
+    return buffers[next];
+}
+
+void FieldWriter::submit()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending[next] = true;
+        next = (next + 1) % numBuffers;
+    }
+    changed.notify_all();
+}
+
+void FieldWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]{
+        for(size_t b=0; b< numBuffers; ++b)
+            if(pending[b])
+                return false;
+        return true;
+    });
+}
+
+size_t FieldWriter::snapshotsWritten()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return numWritten;
+}
+
+double FieldWriter::waitTime()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return waited;
+}
+
+void FieldWriter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    for(;;){
+
+        // The pending snapshots are written before the thread stops
+        changed.wait(lock, [this]{ return pending[writing] || stop; });
+        if(!pending[writing])
+            return;
+
+        // The buffer is not touched by the time loop until it is released below
+        lock.unlock();
+        write(buffers[writing]);
+        lock.lock();
+
+        pending[writing] = false;
+        writing = (writing + 1) % numBuffers;
+        ++numWritten;
+        changed.notify_all();
+    }
+}
+
+void FieldWriter::write(FieldSnapshot& snapshot)
+{
+    snapshot.computeVorticity();
+
+    char step[32];
+    std::snprintf(step, sizeof(step), "_%06zu", snapshot.timeStep);
+    const std::string base = prefix + step;
+
+    if(formats & vtkImageData)
+        writeVTK(snapshot, base + ".vti");
+    if(formats & xdmfRaw)
+        writeXDMF(snapshot, base);
+    if(formats & pngImage)
+        writePNG(snapshot, base + ".png");
+    if(formats & compressedSeries)
+        writeSeries(snapshot);
+
+    LOG_DEBUG("Fields of time step " << snapshot.timeStep << " written to " << base);
+}
+
+void FieldWriter::writeVTK(const FieldSnapshot& snapshot, const std::string& path) const
+{
+    const size_t numCells = snapshot.sizeX * snapshot.sizeY;
+
+    // Every appended array is preceded by its size in bytes (header_type UInt64)
+    const uint64_t scalarBytes = numCells * sizeof(float);
+    const uint64_t vectorBytes = 3 * scalarBytes;
+
+    std::ostringstream header;
+    header << "<?xml version=\"1.0\"?>\n"
+           << "<VTKFile type=\"ImageData\" version=\"1.0\" byte_order=\"" << (littleEndian() ? "LittleEndian" : "BigEndian")
+           << "\" header_type=\"UInt64\">\n"
+           << "  <ImageData WholeExtent=\"0 " << snapshot.sizeX << " 0 " << snapshot.sizeY << " 0 0\" Origin=\"0 0 0\" Spacing=\""
+           << snapshot.spacing << " " << snapshot.spacing << " 1\">\n"
+           << "    <FieldData>\n"
+           << "      <DataArray type=\"Float64\" Name=\"TimeValue\" NumberOfTuples=\"1\" format=\"ascii\">" << snapshot.timeStep << "</DataArray>\n"
+           << "    </FieldData>\n"
+           << "    <Piece Extent=\"0 " << snapshot.sizeX << " 0 " << snapshot.sizeY << " 0 0\">\n"
+           << "      <CellData Scalars=\"density\" Vectors=\"velocity\">\n"
+           << "        <DataArray type=\"Float32\" Name=\"density\" format=\"appended\" offset=\"0\"/>\n"
+           << "        <DataArray type=\"Float32\" Name=\"velocity\" NumberOfComponents=\"3\" format=\"appended\" offset=\""
+           << sizeof(uint64_t) + scalarBytes << "\"/>\n"
+           << "        <DataArray type=\"Float32\" Name=\"vorticity\" format=\"appended\" offset=\""
+           << 2 * sizeof(uint64_t) + scalarBytes + vectorBytes << "\"/>\n"
+           << "      </CellData>\n"
+           << "    </Piece>\n"
+           << "  </ImageData>\n"
+           << "  <AppendedData encoding=\"raw\">\n"
+           << "   _";
+
+    std::ofstream out(path.c_str(), std::ios::binary);
+    const std::string text = header.str();
+    out.write(text.data(), std::streamsize(text.size()));
+
+    writeBinary(out, &scalarBytes, 1);
+    writeBinary(out, snapshot.density.data(), numCells);
+    writeBinary(out, &vectorBytes, 1);
+    writeBinary(out, snapshot.velocity.data(), 3 * numCells);
+    writeBinary(out, &scalarBytes, 1);
+    writeBinary(out, snapshot.vorticity.data(), numCells);
+
+    out << "\n  </AppendedData>\n</VTKFile>\n";
+
+    if(!out)
+        LOG_ERROR("Could not write " << path);
+}
+
+void FieldWriter::writeXDMF(const FieldSnapshot& snapshot, const std::string& base) const
+{
+    const size_t numCells = snapshot.sizeX * snapshot.sizeY;
+    const std::string rawPath = base + ".raw";
+    const std::string xmfPath = base + ".xmf";
+
+    // density, velocity and vorticity one after another
+    std::ofstream raw(rawPath.c_str(), std::ios::binary);
+    writeBinary(raw, snapshot.density.data(), numCells);
+    writeBinary(raw, snapshot.velocity.data(), 3 * numCells);
+    writeBinary(raw, snapshot.vorticity.data(), numCells);
+
+    if(!raw) {
+        LOG_ERROR("Could not write " << rawPath);
+        return;
+    }
+
+    // The raw file is referenced relative to the xmf file
+    const std::string rawName = rawPath.substr(rawPath.find_last_of('/') + 1);
+    const size_t scalarBytes = numCells * sizeof(float);
+
+    std::ostringstream dims, vectorDims;
+    dims << snapshot.sizeY << " " << snapshot.sizeX;
+    vectorDims << dims.str() << " 3";
+
+    std::ofstream xmf(xmfPath.c_str());
+    xmf << "<?xml version=\"1.0\" ?>\n"
+        << "<Xdmf Version=\"3.0\">\n"
+        << "  <Domain>\n"
+        << "    <Grid Name=\"lbm\" GridType=\"Uniform\">\n"
+        << "      <Time Value=\"" << snapshot.timeStep << "\"/>\n"
+        << "      <Topology TopologyType=\"2DCoRectMesh\" Dimensions=\"" << snapshot.sizeY + 1 << " " << snapshot.sizeX + 1 << "\"/>\n"
+        << "      <Geometry GeometryType=\"ORIGIN_DXDY\">\n"
+        << "        <DataItem Format=\"XML\" NumberType=\"Float\" Dimensions=\"2\">0 0</DataItem>\n"
+        << "        <DataItem Format=\"XML\" NumberType=\"Float\" Dimensions=\"2\">" << snapshot.spacing << " " << snapshot.spacing << "</DataItem>\n"
+        << "      </Geometry>\n";
+
+    const char* const names[] = {"density", "velocity", "vorticity"};
+    const size_t seek[] = {0, scalarBytes, 4 * scalarBytes};
+
+    for(size_t a=0; a< 3; ++a)
+        xmf << "      <Attribute Name=\"" << names[a] << "\" AttributeType=\"" << (a == 1 ? "Vector" : "Scalar") << "\" Center=\"Cell\">\n"
+            << "        <DataItem Format=\"Binary\" NumberType=\"Float\" Precision=\"4\" Endian=\"Native\" Seek=\"" << seek[a]
+            << "\" Dimensions=\"" << (a == 1 ? vectorDims.str() : dims.str()) << "\">" << rawName << "</DataItem>\n"
+            << "      </Attribute>\n";
+
+    xmf << "    </Grid>\n"
+        << "  </Domain>\n"
+        << "</Xdmf>\n";
+
+    if(!xmf)
+        LOG_ERROR("Could not write " << xmfPath);
+}
+
+void FieldWriter::writePNG(const FieldSnapshot& snapshot, const std::string& path) const
+{
+    const size_t numCells = snapshot.sizeX * snapshot.sizeY;
+
+    // Speed or vorticity of the fluid cells
+    std::vector<float> value(numCells, 0.0f);
+    float maximum = 0.0f;
+
+    for(size_t cell=0; cell< numCells; ++cell){
+
+        if(!snapshot.fluid[cell])
+            continue;
+
+        if(imageField == imageSpeed) {
+            const float ux = snapshot.velocity[3*cell];
+            const float uy = snapshot.velocity[3*cell + 1];
+            value[cell] = std::sqrt(ux*ux + uy*uy);
+        }
+        else
+            value[cell] = snapshot.vorticity[cell];
+
+        maximum = std::max(maximum, std::fabs(value[cell]));
+    }
+
+    const float range = imageRange > 0.0 ? float(imageRange) : maximum;
+    const float scale = range > 0.0f ? 1.0f / range : 0.0f;
+
+    // Fluid cells are 1 ... 255, obstacles 0. GrayScaleImage counts y from the bottom like the lattice.
+    GrayScaleImage image(unsigned(snapshot.sizeX), unsigned(snapshot.sizeY));
+
+    for(size_t j=0; j< snapshot.sizeY; ++j)
+        for(size_t i=0; i< snapshot.sizeX; ++i){
+
+            const size_t cell = j*snapshot.sizeX + i;
+            unsigned char pixel = 0;
+
+            if(snapshot.fluid[cell]) {
+                const float v = value[cell] * scale;
+                const float level = imageField == imageSpeed ? std::min(v, 1.0f) : 0.5f + 0.5f * std::max(-1.0f, std::min(v, 1.0f));
+                pixel = static_cast<unsigned char>(1.5f + 254.0f * level);
+            }
+
+            image.getElement(int(i), int(j)) = pixel;
+        }
+
+    try {
+        image.save(path, true);
+    }
+    catch(const std::invalid_argument&) {
+        LOG_ERROR("Could not write " << path);
+    }
+}
+
+void FieldWriter::writeSeries(const FieldSnapshot& snapshot)
+{
+    try {
+        if(!series)
+            series.reset(new SeriesWriter(prefix + ".lbms", snapshot, seriesSettings, seriesFirstStep));
+
+        series->append(snapshot);
+    }
+    catch(const std::runtime_error& e) {
+        // Once, the series is left out from then on
+        LOG_ERROR(e.what());
+        series.reset();
+        formats &= ~unsigned(compressedSeries);
+    }
+}
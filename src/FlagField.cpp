@@ -0,0 +1,140 @@
+#include "FlagField.hpp"
+#include "imageClass/GrayScaleImage.h"
+
+FlagField::FlagField(const size_t& dim_x, const size_t& dim_y) : numCellsX(dim_x), numCellsY(dim_y)
+{
+    wordsPerRow = (numCellsX + 63) / 64;
+
+    obstacle_.assign(wordsPerRow * numCellsY, 0);
+    boundary_.assign(wordsPerRow * numCellsY, 0);
+
+    // No-slip walls in the north and south
+    for(size_t i=0; i< numCellsX; ++i){
+        setObstacle(i, 0);
+        setObstacle(i, numCellsY - 1);
+    }
+
+    updateBoundary();
+}
+
+void FlagField::setBit(std::vector<uint64_t>& bits, const size_t& wordsPerRow, const size_t& i, const size_t& j, const bool& value)
+{
+    const uint64_t mask = uint64_t(1) << (i%64);
+
+    if(value)
+        bits[j*wordsPerRow + i/64] |= mask;
+    else
+        bits[j*wordsPerRow + i/64] &= ~mask;
+}
+
+void FlagField::setObstacle(const size_t& i, const size_t& j, const bool& value)
+{
+    assert(i < numCellsX && j < numCellsY);
+    setBit(obstacle_, wordsPerRow, i, j, value);
+}
+
+void FlagField::addCylinder(const real& centerX, const real& centerY, const real& radius)
+{
+    // Centre of cell i is at i - 0.5, the first non ghost cell being 1
+    for(size_t j=1; j< numCellsY - 1; ++j)
+        for(size_t i=1; i< numCellsX - 1; ++i){
+
+            const real x = real(i) - 0.5 - centerX;
+            const real y = real(j) - 0.5 - centerY;
+
+            if(x*x + y*y <= radius*radius)
+                setObstacle(i, j);
+        }
+
+    updateBoundary();
+}
+
+void FlagField::addImage(const std::string& pngFilename)
+{
+    const GrayScaleImage image = GrayScaleImage(pngFilename).getResizedImage(numCellsX - 2, numCellsY - 2);
+
+    for(size_t j=1; j< numCellsY - 1; ++j)
+        for(size_t i=1; i< numCellsX - 1; ++i)
+            if(image(int(i - 1), int(j - 1)) < 0.5)
+                setObstacle(i, j);
+
+    updateBoundary();
+}
+
+void FlagField::updateBoundary()
+{
+    boundary_.assign(boundary_.size(), 0);
+
+    for(size_t j=1; j< numCellsY - 1; ++j)
+        for(size_t i=1; i< numCellsX - 1; ++i){
+
+            if(isObstacle(i, j))
+                continue;
+
+            for(size_t q=1; q< Stencil::Q; ++q)
+                if(isObstacle(periodicX(i + Stencil::cx[q]), j + Stencil::cy[q])) {
+                    setBit(boundary_, wordsPerRow, i, j, true);
+                    break;
+                }
+        }
+}
+
+size_t FlagField::periodicX(const size_t& i) const
+{
+    // The ghost columns stand for the last / first non ghost column
+    if(i == 0)
+        return numCellsX - 2;
+    if(i == numCellsX - 1)
+        return 1;
+    return i;
+}
+
+void FlagField::boundaryLinks(std::vector<BoundaryLink>& links, std::vector<size_t>& rowBegin) const
+{
+    links.clear();
+    rowBegin.assign(numCellsY + 1, 0);
+
+    for(size_t j=0; j< numCellsY; ++j){
+
+        rowBegin[j] = links.size();
+
+        if(j == 0 || j == numCellsY - 1)
+            continue;
+
+        for(size_t i=1; i< numCellsX - 1; ++i){
+
+            if(!isBoundary(i, j))
+                continue;
+
+            // f_q streams in from cell (i,j) - c_q
+            for(size_t q=1; q< Stencil::Q; ++q)
+                if(isObstacle(periodicX(i - Stencil::cx[q]), j - Stencil::cy[q])) {
+                    BoundaryLink link = {uint32_t(i), uint32_t(q)};
+                    links.push_back(link);
+                }
+        }
+    }
+
+    rowBegin[numCellsY] = links.size();
+}
+
+size_t FlagField::fluidCells() const
+{
+    size_t count = 0;
+
+    // Sum up the runs of fluid cells
+    for(size_t j=1; j< numCellsY - 1; ++j)
+        for(size_t i= nextFluid(j, 1, numCellsX - 1); i< numCellsX - 1; ){
+
+            const size_t runEnd = nextObstacle(j, i, numCellsX - 1);
+            count += runEnd - i;
+            i = nextFluid(j, runEnd, numCellsX - 1);
+        }
+
+    return count;
+}
+
+double FlagField::fluidFraction() const
+{
+    return double(fluidCells()) / (double(numCellsX - 2) * double(numCellsY - 2));
+}
@@ -1,4 +1,5 @@
 #include "Lattice.hpp"
+#include "Log.hpp"
 
 //Initialise the static map
 // C, N W, N, N E, W, E, SW, S, SE
@@ -6,67 +7,52 @@
 //Map Lattice::dirMap ={{"C", 0}, {"N", 1}, {"S", 2}, {"W", 3}, {"E", 4}, {"NE", 5}, {"NW", 6}, {"SW", 7}, {"SE", 8} };
 
 
-constexpr real Lattice::weights[] ;//= {4.0/9.0, 1.0/9.0, 1.0/9.0, 1.0/9.0, 1.0/9.0, 1.0/36.0, 1.0/36.0, 1.0/36.0, 1.0/36.0};
+template<typename Layout, typename Storage>
+Lattice<Layout, Storage>::Lattice(const size_t& dim_x, const size_t& dim_y){
 
-Lattice::Lattice(const size_t& dim_x, const size_t& dim_y){
-
-    std::cout << "c'tr of Lattice" << std::endl;
-    std::cout<<" \n "<< std::endl;
+    LOG_DEBUG("c'tr of Lattice");
 
     this->numCellsX = dim_x;
     this->numCellsY = dim_y;
-    this->data_.resize(dim_x * dim_y * NUM_DIR);
+    this->numCells = dim_x * dim_y;
+    this->data_.resize(Layout::size(numCells));
 }
 
 
-// Initialise the lattice with weights.
-void Lattice::init() {
-
-    for(size_t i=0; i< data_.size(); ++i) {
-    this->data_[i] = weights[i % NUM_DIR] + i/NUM_DIR;
-    }
-}
-
-
-
-real& Lattice::operator() (const size_t& i, const size_t& j, const Direction& dir){
+// Initialise the lattice with weights, i.e. the equilibrium of a fluid at rest.
+template<typename Layout, typename Storage>
+void Lattice<Layout, Storage>::init() {
 
-   assert(i>=0 && j>=0  && i <numCellsX &&  j <numCellsY);
-    //std::cout << "NON const version operator() called\n";
-    return this->data_[NUM_DIR*(j*numCellsX + i) + dir];
-}
-
-real& Lattice::operator() (const size_t& i, const size_t& j, const size_t& k){
+    // Non ghost rows, first touch by the thread that updates them in the sweeps
+    #pragma omp parallel for schedule(static)
+    for(size_t j=1; j< numCellsY - 1; ++j)
+        initRow(j);
 
-    assert(i>=0 && j>=0 && k>=0 && i <numCellsX &&  j <numCellsY && k <NUM_DIR);
-    //std::cout << "NON const version operator() called\n";
-    return this->data_[NUM_DIR*(j*numCellsX + i) + k];
+    // Ghost rows
+    initRow(0);
+    initRow(numCellsY - 1);
 }
 
-const real& Lattice::operator() (const size_t& i, const size_t& j, const Direction& dir) const{
+template<typename Layout, typename Storage>
+void Lattice<Layout, Storage>::initRow(const size_t& j) {
 
-    assert(i>=0 && j>=0 && i <numCellsX &&  j <numCellsY);
-    //std::cout << "Const version operator() called\n";
-
-    return this->data_[NUM_DIR*(j*numCellsX + i)+ dir];
+    for(size_t cell= j*numCellsX; cell< (j + 1)*numCellsX; ++cell) {
+        for(size_t q=0; q< Stencil::Q; ++q)
+            this->data_[Layout::index(cell, q, numCells)] = Storage::store(Stencil::w[q], Stencil::w[q]);
+    }
 }
 
-const real& Lattice::operator() (const size_t& i, const size_t& j, const size_t& k) const{
 
-    assert(i>=0 && j>=0 && k>=0 && i <numCellsX &&  j <numCellsY && k <NUM_DIR);
-    std::cout << "Const version operator() called\n";
 
-    return this->data_[NUM_DIR*(j*numCellsX + i)+ k];
-}
-
-void Lattice::display() const {
+template<typename Layout, typename Storage>
+void Lattice<Layout, Storage>::display() const {
 
 //    size_t counter =0;
 //    for (auto const &f_q : this->data_)
 //        {
 //            std::cout << f_q << "\t" ;
 
-//            counter = (counter + 1) % NUM_DIR;
+//            counter = (counter + 1) % Stencil::Q;
 //            if(counter ==0)
 //                std::cout << std::endl;
 //        }
@@ -76,25 +62,25 @@ void Lattice::display() const {
         std::cout << std::endl;
 
         for(size_t i = 0; i < numCellsX; ++i){
-            std::cout << (*this)(i,j, NW) << "\t";
-            std::cout << (*this)(i,j, N) << "\t";
-            std::cout << (*this)(i,j, NE) << "\t";
+            std::cout << get(i,j, NW) << "\t";
+            std::cout << get(i,j, N) << "\t";
+            std::cout << get(i,j, NE) << "\t";
             std::cout << "\t";
         }
         std::cout << std::endl;
 
         for(size_t i = 0; i < numCellsX; ++i){
-            std::cout << (*this)(i,j, W) << "\t";
-            std::cout << (*this)(i,j, C) << "\t";
-            std::cout << (*this)(i,j, E) << "\t";
+            std::cout << get(i,j, W) << "\t";
+            std::cout << get(i,j, C) << "\t";
+            std::cout << get(i,j, E) << "\t";
             std::cout << "\t";
         }
         std::cout << std::endl;
 
         for(size_t i = 0; i < numCellsX; ++i){
-            std::cout << (*this)(i,j, SW) << "\t";
-            std::cout << (*this)(i,j, S) << "\t";
-            std::cout << (*this)(i,j, SE) << "\t";
+            std::cout << get(i,j, SW) << "\t";
+            std::cout << get(i,j, S) << "\t";
+            std::cout << get(i,j, SE) << "\t";
             std::cout << "\t";
         }
         std::cout << std::endl;
@@ -103,5 +89,13 @@ void Lattice::display() const {
 
 }
 
+// The layouts and storage types the library is built for
+#define LBM_INSTANTIATE_LATTICE(Layout) \
+    template class Lattice<Layout, PlainStorage<double> >; \
+    template class Lattice<Layout, PlainStorage<float> >; \
+    template class Lattice<Layout, ShiftedStorage<float> >;
 
-
+LBM_INSTANTIATE_LATTICE(AoS)
+LBM_INSTANTIATE_LATTICE(SoA)
+LBM_INSTANTIATE_LATTICE(AoSoA<4>)
+LBM_INSTANTIATE_LATTICE(AoSoA<8>)
@@ -0,0 +1,209 @@
+#include "Log.hpp"
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>      // getenv
+#include <cstring>      // strcmp, memcpy
+#include <iostream>
+
+static LogLevel levelFromEnvironment()
+{
+    const char* requested = std::getenv("LBM_LOG_LEVEL");
+    if(!requested)
+        return logInfo;
+
+    if(std::strcmp(requested, "debug") == 0)   return logDebug;
+    if(std::strcmp(requested, "info") == 0)    return logInfo;
+    if(std::strcmp(requested, "warning") == 0) return logWarning;
+    if(std::strcmp(requested, "error") == 0)   return logError;
+    if(std::strcmp(requested, "off") == 0)     return logOff;
+
+    std::cerr << "LBM_LOG_LEVEL=" << requested << " is unknown, choose debug, info, warning, error or off" << std::endl;
+    return logInfo;
+}
+
+static std::atomic<int>& runtimeLevel()
+{
+    static std::atomic<int> level(levelFromEnvironment());
+    return level;
+}
+
+
+// Bounded ring buffer of messages, many threads write, the writer thread reads.
+// The producers take a ticket by incrementing head, ticket t goes to slot t % numSlots.
+// The sequence no. of a slot tells its state: t if it is free for ticket t, t + 1 if it
+// holds the message of ticket t. The writer sets it to t + numSlots once the message is
+// written, which frees the slot for the ticket one round later. No locks are taken by the
+// producers, they only wait if the ring is full.
+class LogRing{
+
+private:
+    static const size_t numSlots = 256;    // power of two
+    static const size_t textSize = 512;    // longer messages bypass the ring, see push
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        LogLevel level;
+        size_t length;
+        char text[textSize];
+    };
+
+    Slot slots[numSlots];
+
+    std::atomic<size_t> head;      // next ticket of the producers
+    size_t tail;                   // next ticket of the writer thread
+    std::atomic<size_t> written;   // messages written out so far
+    std::atomic<bool> stop;
+
+    // Only the writer waits, the timeout covers a wake up lost because the producers
+    // notify without taking the mutex
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::thread writer;
+
+    bool ready() const { return slots[tail % numSlots].sequence.load(std::memory_order_acquire) == tail + 1; }
+    void run();
+
+public:
+    LogRing();
+    ~LogRing();
+
+    void push(const LogLevel&, const std::string&);
+    void flush();
+};
+
+LogRing::LogRing() : head(0), tail(0), written(0), stop(false)
+{
+    for(size_t k=0; k< numSlots; ++k)
+        slots[k].sequence.store(k, std::memory_order_relaxed);
+
+    writer = std::thread(&LogRing::run, this);
+}
+
+LogRing::~LogRing()
+{
+    stop.store(true, std::memory_order_release);
+    wakeUp.notify_one();
+    writer.join();
+}
+
+static const char* const prefix[] = {"Debug: ", "", "Warning: ", "Error: "};
+
+void LogRing::push(const LogLevel& level, const std::string& message)
+{
+    // Too long for a slot (usage lines, paths): written by the calling thread once the queued
+    // messages are out, so the order is kept. Rare enough for the wait not to matter.
+    if(message.size() > textSize) {
+        flush();
+
+        const std::string line = prefix[level] + message + '\n';
+        std::ostream& out = level >= logWarning ? std::cerr : std::cout;
+        out.write(line.data(), std::streamsize(line.size()));
+        out.flush();
+        return;
+    }
+
+    size_t ticket = head.load(std::memory_order_relaxed);
+
+    for(;;){
+        const size_t sequence = slots[ticket % numSlots].sequence.load(std::memory_order_acquire);
+        const std::ptrdiff_t diff = std::ptrdiff_t(sequence) - std::ptrdiff_t(ticket);
+
+        if(diff == 0) {
+            if(head.compare_exchange_weak(ticket, ticket + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if(diff < 0) {
+            // Full, the slot still holds the message of the previous round
+            wakeUp.notify_one();
+            std::this_thread::yield();
+            ticket = head.load(std::memory_order_relaxed);
+        }
+        else
+            ticket = head.load(std::memory_order_relaxed);
+    }
+
+    Slot& slot = slots[ticket % numSlots];
+    slot.level = level;
+    slot.length = message.size();
+    std::memcpy(slot.text, message.data(), slot.length);
+
+    slot.sequence.store(ticket + 1, std::memory_order_release);
+    wakeUp.notify_one();
+}
+
+void LogRing::run()
+{
+    for(;;){
+
+        // Everything queued so far, the console is flushed once per batch
+        bool any = false;
+        while(ready()) {
+
+            Slot& slot = slots[tail % numSlots];
+            std::ostream& out = slot.level >= logWarning ? std::cerr : std::cout;
+
+            out << prefix[slot.level];
+            out.write(slot.text, std::streamsize(slot.length));
+            out << '\n';
+
+            slot.sequence.store(tail + numSlots, std::memory_order_release);
+            ++tail;
+            any = true;
+        }
+
+        if(any) {
+            std::cout.flush();
+            std::cerr.flush();
+            written.store(tail, std::memory_order_release);
+        }
+
+        if(stop.load(std::memory_order_acquire) && head.load(std::memory_order_acquire) == tail)
+            return;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeUp.wait_for(lock, std::chrono::milliseconds(10),
+                        [this]{ return ready() || stop.load(std::memory_order_acquire); });
+    }
+}
+
+void LogRing::flush()
+{
+    const size_t target = head.load(std::memory_order_acquire);
+
+    while(written.load(std::memory_order_acquire) < target) {
+        wakeUp.notify_one();
+        std::this_thread::yield();
+    }
+}
+
+// Created with the first message, written out and stopped at program exit
+static LogRing& logRing()
+{
+    static LogRing ring;
+    return ring;
+}
+
+
+LogLevel logLevel()
+{
+    return LogLevel(runtimeLevel().load(std::memory_order_relaxed));
+}
+
+void setLogLevel(const LogLevel& level)
+{
+    runtimeLevel().store(level, std::memory_order_relaxed);
+}
+
+void logWrite(const LogLevel& level, const std::string& message)
+{
+    logRing().push(level, message);
+}
+
+void logFlush()
+{
+    logRing().flush();
+}
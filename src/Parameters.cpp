@@ -1,15 +1,16 @@
 #include "Parameters.hpp"
+#include "Log.hpp"
 
 
 Parameters::Parameters(std::string& temp) : length_(0.06), width_(0.02), dia_(0.005), centerX_(0.02), centerY_(0.008)
 {
 
-    std::cout << "c'tr of Parameter " << std::endl;
+    LOG_DEBUG("c'tr of Parameter ");
 
     //   scene_ = temp;
     if (temp == "scenario1") { scene_ =1; }
     else if(temp == "scenario2") {scene_ = 2;}
-    else { std::cout<< "No matching scenarios found !" <<std::endl; }
+    else { LOG_ERROR("No matching scenarios found !"); }
 
 }
 
@@ -41,22 +42,22 @@ void Parameters::calcDomDim()
         acceleration =  0.01;       // m/s^2
         cylinderResolution = 30;    // no. of cells
 
-        std::cout<<" \n " << std::endl;
-        std::cout<< "*****Param of Scenario 1 ******"<< std::endl;
+        LOG_INFO("");
+        LOG_INFO("*****Param of Scenario 1 ******");
 
-        std::cout<< "Diameter :" << dia_ << std::endl;
-        std::cout<< "Cylinder Resolution :" << cylinderResolution << std::endl;
+        LOG_INFO("Diameter :" << dia_);
+        LOG_INFO("Cylinder Resolution :" << cylinderResolution);
 
-        std::cout<< "length_ :" << length_ << std::endl;
-        std::cout<< "width_ :" << width_ << std::endl;
-        std::cout<<" \n "<< std::endl;
+        LOG_INFO("length_ :" << length_);
+        LOG_INFO("width_ :" << width_);
+        LOG_INFO("");
 
         dx = dia_ / cylinderResolution;
         //dt = 1e-11;
         dt = 1e-4;
 
-        std::cout<< "dx :" << dx << std::endl;
-        std::cout<< "dt :" << dt << std::endl;
+        LOG_INFO("dx :" << dx);
+        LOG_INFO("dt :" << dt);
 
         nx = length_ / dx;
         ny = width_ / dx;
@@ -65,17 +66,19 @@ void Parameters::calcDomDim()
         latticeAcc = convAcc(acceleration, dx, dt);
 
         relaxRate = 1 / ((3*latticeVisc) + 0.5);
+        timeSteps = static_cast<size_t>(simTime / dt + 0.5);
 
-        std::cout<<" \n " << std::endl;
-        std::cout<< "*****Param after conversion ******"<< std::endl;
+        LOG_INFO("");
+        LOG_INFO("*****Param after conversion ******");
 
-        std::cout<< "No. of cells in X :" << nx << std::endl;
-        std::cout<< "No. of cells in Y :" << ny << std::endl;
+        LOG_INFO("No. of cells in X :" << nx);
+        LOG_INFO("No. of cells in Y :" << ny);
 
-        std::cout<< "latticeVisc :" << latticeVisc << std::endl;
-        std::cout<< "latticeAcc :" << latticeAcc << std::endl;
-        std::cout<< "relaxRate :" << relaxRate << std::endl;
-        std::cout<<" \n "<< std::endl;
+        LOG_INFO("latticeVisc :" << latticeVisc);
+        LOG_INFO("latticeAcc :" << latticeAcc);
+        LOG_INFO("relaxRate :" << relaxRate);
+        LOG_INFO("timeSteps :" << timeSteps);
+        LOG_INFO("");
 
         break;
 
@@ -85,21 +88,21 @@ void Parameters::calcDomDim()
         acceleration =  0.016;       // m/s^2
         cylinderResolution = 60;    // no. of cells
 
-        std::cout<<" \n " << std::endl;
-        std::cout<< "*****Param of Scenario 2 ******"<< std::endl;
+        LOG_INFO("");
+        LOG_INFO("*****Param of Scenario 2 ******");
 
-        std::cout<< "Diameter :" << dia_ << std::endl;
-        std::cout<< "Cylinder Resolution :" << cylinderResolution << std::endl;
+        LOG_INFO("Diameter :" << dia_);
+        LOG_INFO("Cylinder Resolution :" << cylinderResolution);
 
-        std::cout<< "length_ :" << length_ << std::endl;
-        std::cout<< "width_ :" << width_ << std::endl;
-        std::cout<<" \n "<< std::endl;
+        LOG_INFO("length_ :" << length_);
+        LOG_INFO("width_ :" << width_);
+        LOG_INFO("");
 
         dx = dia_ / cylinderResolution;
         dt = 1e-4;
 
-        std::cout<< "dx :" << dx << std::endl;
-        std::cout<< "dt :" << dt << std::endl;
+        LOG_INFO("dx :" << dx);
+        LOG_INFO("dt :" << dt);
 
         nx = length_ / dx;
         ny = width_ / dx;
@@ -108,24 +111,46 @@ void Parameters::calcDomDim()
         latticeAcc = convAcc(acceleration, dx, dt);
 
         relaxRate = 1 / ((3*latticeVisc) + 0.5);
+        timeSteps = static_cast<size_t>(simTime / dt + 0.5);
 
-        std::cout<<" \n " << std::endl;
-        std::cout<< "*****Param after conversion ******"<< std::endl;
+        LOG_INFO("");
+        LOG_INFO("*****Param after conversion ******");
 
-        std::cout<< "No. of cells in X :" << nx << std::endl;
-        std::cout<< "No. of cells in Y :" << ny << std::endl;
+        LOG_INFO("No. of cells in X :" << nx);
+        LOG_INFO("No. of cells in Y :" << ny);
 
-        std::cout<< "latticeVisc :" << latticeVisc << std::endl;
-        std::cout<< "latticeAcc :" << latticeAcc << std::endl;
-        std::cout<< "relaxRate :" << relaxRate << std::endl;
-        std::cout<<" \n "<< std::endl;
+        LOG_INFO("latticeVisc :" << latticeVisc);
+        LOG_INFO("latticeAcc :" << latticeAcc);
+        LOG_INFO("relaxRate :" << relaxRate);
+        LOG_INFO("timeSteps :" << timeSteps);
+        LOG_INFO("");
 
         break;
 
      default:
-        std::cerr << "Please choose scenario1 OR scenario2\n";
+        LOG_ERROR("Please choose scenario1 OR scenario2");
 
     }
 
 
 }
+
+
+void Parameters::buildGeometry(FlagField& flags, const std::string& geometry) const
+{
+    if(geometry == "none")
+        return;
+
+    if(geometry == "cylinder") {
+
+        // Cylinder in cells, the grid may be a scaled version of the one of the scenario
+        const real scaleX = real(flags.sizeX() - 2) / nx;
+        const real scaleY = real(flags.sizeY() - 2) / ny;
+
+        flags.addCylinder(centerX_ / dx * scaleX, centerY_ / dx * scaleY, 0.5 * dia_ / dx * std::min(scaleX, scaleY));
+    }
+    else
+        flags.addImage(geometry);
+
+    LOG_INFO("Geometry :" << geometry << " (fluid fraction " << flags.fluidFraction() << ")");
+}
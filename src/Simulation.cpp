@@ -1,32 +1,100 @@
 #include "Simulation.hpp"
+#include "Parameters.hpp"
+#include "Threading.hpp"
+#include "StreamBenchmark.hpp"
+#include "Log.hpp"
+#include "Checkpoint.hpp"
+#include <utility>      // std::swap
+#include <algorithm>    // std::min, std::max, std::lower_bound
+#include <chrono>
+#include <string>
+#include <cassert>
+#include <cstring>      // strncpy, strncmp
+#include <stdexcept>
 
-constexpr int Simulation::dir_x[];
-constexpr int Simulation::dir_y[];
-
-Simulation::Simulation(const size_t& dim_x, const size_t& dim_y){
+template<typename Layout, typename Storage>
+Simulation<Layout, Storage>::Simulation(const size_t& dim_x, const size_t& dim_y, const Propagation& prop, const CollisionModel& model, const real& cs)
+    : flags(dim_x + 2, dim_y + 2){
 
     this->numCellsX = dim_x + 2;
     this->numCellsY = dim_y + 2;
+    this->propagation = prop;
+    this->tileX = 0;
+    this->tileY = 0;
+    this->blockSteps = 1;
+    this->collision = model;
+    this->smagorinsky = cs;
+    this->accX = 0.0;
+    this->accY = 0.0;
+    this->outputInterval = 0;
+    this->imageInterval = 0;
+    this->imageSpacing = 1;
+    this->checkpointInterval = 0;
 
 //    std::cout<<"dim_x & dim_y in Simulation class "<< std::endl;
 //    std::cout << "dim_x :" << dim_x << std::endl;
 //    std::cout << "dim_y :" << dim_y << std::endl;
 //    std::cout<<" \n "<< std::endl;
 
-        std::cout<<"=============  numCellsX & numCellsY in Simulation class =========  "<< std::endl;
-        std::cout << "numCellsX :" << numCellsX << std::endl;
-        std::cout << "numCellsY :" << numCellsY << std::endl;
+        LOG_INFO("=============  numCellsX & numCellsY in Simulation class =========  ");
+        LOG_INFO("numCellsX :" << numCellsX);
+        LOG_INFO("numCellsY :" << numCellsY);
+        LOG_INFO("Layout :" << Layout::name());
+        LOG_INFO("Storage :" << Storage::name());
+        LOG_INFO("Threads :" << numThreads());
+        LOG_INFO("Propagation :" << (propagation == twoLattice ? "two lattices" :
+                                     propagation == aaPattern ? "AA pattern" : "Esoteric Twist"));
+        if(smagorinsky > 0)
+            LOG_INFO("Smagorinsky constant :" << smagorinsky);
+
+    // Before the lattices are touched, so the pages end up next to the pinned threads
+    pinThreads();
 
     //Allocate memory for lattice object pointed by src,
     // Similar to src = new Lattice(dim_x + 2, dim_y + 2);
-    this->src = std::make_shared<Lattice>(this->numCellsX, this->numCellsY);
-    this->dest = std::make_shared<Lattice>(this->numCellsX, this->numCellsY);
+    this->src = std::make_shared<Lattice<Layout, Storage> >(this->numCellsX, this->numCellsY);
+
+    // The AA pattern and the Esoteric Twist work in place, only the two lattice scheme needs dest
+    if(propagation == twoLattice)
+        this->dest = std::make_shared<Lattice<Layout, Storage> >(this->numCellsX, this->numCellsY);
+
+    initState();
+
+    // Bounce back at the walls
+    flags.boundaryLinks(links, linkRowBegin);
+
+    // The rows are collided by the SIMD kernels
+    this->collideKernel = selectCollideKernel<value_type>(collision, smagorinsky > 0);
+}
+
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::initState(){
 
-    // Init src lattice with weights
+    // Init src lattice with weights, dest is initialised as well for the parallel first touch
     src->init();
+    if(dest)
+        dest->init();
+
+    this->timeStep = 0;
+    for(size_t q=0; q< Stencil::Q; ++q)
+        this->twistSlot[q] = q;
+}
+
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::setGeometry(const FlagField& geometry){
+
+    assert(geometry.sizeX() == numCellsX && geometry.sizeY() == numCellsY);
+    this->flags = geometry;
+    flags.boundaryLinks(links, linkRowBegin);
+
+    LOG_INFO("Boundary links :" << links.size());
 }
 
-void Simulation::printLattice(){
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::printLattice(){
+
+    // Straight to the console, after the queued messages
+    logFlush();
 
     std::cout << "Contents of src lattice\n";
     this->src->display();
@@ -36,59 +104,799 @@ void Simulation::printLattice(){
 }
 
 
-void Simulation::setPeriodicBCs(){
+// Two lattices: pull the f_q's from the neighbours in src, write them to the cell in dest
+template<typename Layout, typename Storage>
+template<bool Periodic>
+struct Simulation<Layout, Storage>::PullAccess {
+
+    View src;
+    View dest;
+
+    value_type& in(const size_t& i, const size_t& j, const size_t& q) const {
+        if(Periodic)
+            return src(column<true>(i - Stencil::cx[q], src.sizeX()), j - Stencil::cy[q], q);
+        return src(src.neighbour(src.cell(i, j), Stencil::opposite[q]), q);
+    }
+    value_type& out(const size_t& i, const size_t& j, const size_t& q) const {
+        return dest(dest.cell(i, j), q);
+    }
+    PullAccess<true> periodic() const { return PullAccess<true>{src, dest}; }
+};
+
+// AA pattern, even step: read the cell's own f_q's and store them back swapped to the
+// opposite direction, no neighbour is touched. Only the bounce back asks for the ghost
+// columns, which then stand for their periodic image.
+template<typename Layout, typename Storage>
+template<bool Periodic>
+struct Simulation<Layout, Storage>::AAEvenAccess {
+
+    View lattice;
+
+    value_type& in(const size_t& i, const size_t& j, const size_t& q) const {
+        return lattice(lattice.cell(column<Periodic>(i, lattice.sizeX()), j), q);
+    }
+    value_type& out(const size_t& i, const size_t& j, const size_t& q) const {
+        return lattice(lattice.cell(column<Periodic>(i, lattice.sizeX()), j), Stencil::opposite[q]);
+    }
+    AAEvenAccess<true> periodic() const { return AAEvenAccess<true>{lattice}; }
+};
+
+// AA pattern, odd step: pull the swapped f_q's from the neighbours and push the collided
+// ones to the neighbours, which restores the natural order of the even step
+template<typename Layout, typename Storage>
+template<bool Periodic>
+struct Simulation<Layout, Storage>::AAOddAccess {
+
+    View lattice;
+
+    value_type& in(const size_t& i, const size_t& j, const size_t& q) const {
+        if(Periodic)
+            return lattice(column<true>(i - Stencil::cx[q], lattice.sizeX()), j - Stencil::cy[q], Stencil::opposite[q]);
+        return lattice(lattice.neighbour(lattice.cell(i, j), Stencil::opposite[q]), Stencil::opposite[q]);
+    }
+    value_type& out(const size_t& i, const size_t& j, const size_t& q) const {
+        if(Periodic)
+            return lattice(column<true>(i + Stencil::cx[q], lattice.sizeX()), j + Stencil::cy[q], q);
+        return lattice(lattice.neighbour(lattice.cell(i, j), q), q);
+    }
+    AAOddAccess<true> periodic() const { return AAOddAccess<true>{lattice}; }
+};
+
+
+// Esoteric Twist: f_q of cell x is kept at x + max(-c_q, 0), i.e. in the cell itself or in its
+// north/east neighbours. The collided f_q overwrites the location f_opposite(q) was read from,
+// so every cell reads and writes the same locations. Together with the slot twist after each
+// step this is the streaming, no even/odd variant of the kernel is needed.
+// With the periodic wrap the last column keeps its f_q's with c_q < 0 in the first column,
+// where no cell of the domain keeps any.
+template<typename Layout, typename Storage>
+template<bool Periodic>
+struct Simulation<Layout, Storage>::EsoTwistAccess {
+
+    View lattice;
+    const size_t* slot;
+
+    value_type& in(const size_t& i, const size_t& j, const size_t& q) const {
+        return lattice(column<Periodic>(i + (Stencil::cx[q] < 0), lattice.sizeX()), j + (Stencil::cy[q] < 0), slot[q]);
+    }
+    value_type& out(const size_t& i, const size_t& j, const size_t& q) const {
+        return in(i, j, Stencil::opposite[q]);
+    }
+    EsoTwistAccess<true> periodic() const { return EsoTwistAccess<true>{lattice, slot}; }
+};
+
+
+template<typename Layout, typename Storage>
+typename Simulation<Layout, Storage>::value_type& Simulation<Layout, Storage>::incoming(const size_t& i, const size_t& j, const size_t& q){
+
+    if(propagation == twoLattice)
+        return PullAccess<true>{view(*src), view(*dest)}.in(i, j, q);
+
+    if(propagation == esoTwist)
+        return EsoTwistAccess<true>{view(*src), twistSlot}.in(i, j, q);
+
+    if(timeStep % 2 == 0)
+        return AAEvenAccess<true>{view(*src)}.in(i, j, q);
+
+    return AAOddAccess<true>{view(*src)}.in(i, j, q);
+}
+
+
+// Passes incoming() on to the row BC's below, i.e. whatever the current propagation step is
+template<typename Layout, typename Storage>
+struct Simulation<Layout, Storage>::IncomingAccess {
+
+    Simulation<Layout, Storage>* sim;
+
+    value_type& in(const size_t& i, const size_t& j, const size_t& q) const {
+        return sim->incoming(i, j, q);
+    }
+    IncomingAccess periodic() const { return *this; }
+};
+
+
+template<typename Layout, typename Storage>
+template<typename Access>
+void Simulation<Layout, Storage>::bounceBackRow(const Access& access, const size_t& j, const size_t& iBegin, const size_t& iEnd){
+
+    // A f_q streaming into the fluid from a wall or obstacle cell is the f_opposite(q) of the
+    // same cell that hit the solid cell (halfway bounce back). The location written is read by
+    // cell (i,j) only, so the links of a row can be applied right before it is swept.
+    // The stored values are copied as they are, which is fine for shifted storage as well,
+    // since w_q == w_opposite(q).
+    const BoundaryLink* const rowBegin = links.data() + linkRowBegin[j];
+    const BoundaryLink* const rowEnd = links.data() + linkRowBegin[j + 1];
+
+    // First link of column iBegin or later
+    const BoundaryLink cmp = {uint32_t(iBegin), 0};
+    const BoundaryLink* link = std::lower_bound(rowBegin, rowEnd, cmp,
+                                                [](const BoundaryLink& a, const BoundaryLink& b){ return a.i < b.i; });
+
+    // Links of the first and last column may point across the periodic boundary
+    const auto wrapped = access.periodic();
+
+    for(; link != rowEnd && link->i < iEnd; ++link){
+
+        const size_t i = link->i;
+        const size_t q = link->q;
+
+        wrapped.in(i, j, q) = wrapped.in(i - Stencil::cx[q], j - Stencil::cy[q], Stencil::opposite[q]);
+    }
+}
+
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::setNoSlipBCs(){
+
+    // All walls and obstacles. The sweeps apply the links themselves, this is only needed to
+    // look at a consistent state in between.
+    #pragma omp parallel for schedule(static)
+    for(size_t j=1; j< numCellsY - 1; ++j)
+        bounceBackRow(IncomingAccess{this}, j, 1U, numCellsX - 1);
+
+    LOG_DEBUG("Reflective BC's set successfully");
+
+}
 
-    const size_t i_left_src = numCellsX - 2;
-    const size_t i_left_dest = 0U; // left ghost cell
-    const size_t i_right_src = 1U;
-    const size_t i_right_dest = numCellsX - 1; // right ghost cell
 
-    // Iterate over all non ghost cells rows
-    for(size_t j=1; j< numCellsY - 1; ++j){
+template<typename Layout, typename Storage>
+template<typename Access>
+void Simulation<Layout, Storage>::sweepRow(const Access& access, const size_t& j, const size_t& iBegin, const size_t& iEnd, const CollisionRates& rates){
 
-        // Iterate over all direction inside a cell
-        for(size_t q=0; q< NUM_DIR; ++q){
+    // Bounce back of the f_q's coming from walls and obstacles into this part of the row
+    bounceBackRow(access, j, iBegin, iEnd);
 
-            //filling left ghost cell
-            (*src)(i_left_dest,j,q) = (*src)(i_left_src,j,q);
+    // Runs of fluid cells, found 64 cells at a time. Without obstacles in the row this is
+    // a single run.
+    for(size_t i= flags.nextFluid(j, iBegin, iEnd); i< iEnd; ){
 
-            //filling right ghost cell
-            (*src)(i_right_dest,j,q) = (*src)(i_right_src,j,q);
+        const size_t runEnd = flags.nextObstacle(j, i, iEnd);
+
+        // The first and last column stream across the periodic boundary, they are peeled off
+        // so that the inner cells need no index wrapping
+        size_t a = i, b = runEnd;
+
+        if(a == 1) {
+            sweepRun(access.periodic(), j, 1U, 2U, rates);
+            ++a;
         }
+        if(b == numCellsX - 1 && b > a) {
+            sweepRun(access.periodic(), j, b - 1, b, rates);
+            --b;
+        }
+        if(a < b)
+            sweepRun(access, j, a, b, rates);
+
+        i = flags.nextFluid(j, runEnd, iEnd);
+    }
+}
+
+template<typename Layout, typename Storage>
+template<typename Access>
+void Simulation<Layout, Storage>::sweepRun(const Access& access, const size_t& j, const size_t& iBegin, const size_t& iEnd, const CollisionRates& rates){
+
+    if(Layout::unitStride) {
+
+        // The f_q's a row reads (and writes) are contiguous, shifted by the lattice velocity
+        const value_type* in[Stencil::Q];
+        value_type* out[Stencil::Q];
+
+        for(size_t q=0; q< Stencil::Q; ++q){
+            in[q] = &access.in(iBegin, j, q);
+            out[q] = &access.out(iBegin, j, q);
+        }
+
+        BodyForce force;
+        collideKernel.kernel(in, out, iEnd - iBegin, rates,
+                            Storage::shifted ? Stencil::w : nullptr,
+                            bodyForce(force, j*numCellsX + iBegin));
+        return;
+    }
+
+    // Other layouts: the streamed f_q's of up to 64 cells are gathered into unit stride rows,
+    // collided there by the same kernel and scattered to their out locations. Every out
+    // location is only read by the cell writing it, so a block may be written back at once.
+    const size_t blockSize = 64;
+    alignas(64) value_type block[Stencil::Q][blockSize];
+    value_type* rows[Stencil::Q];
+    for(size_t q=0; q< Stencil::Q; ++q)
+        rows[q] = block[q];
+
+    for(size_t ii=iBegin; ii< iEnd; ii+= blockSize){
 
+        const size_t n = std::min(blockSize, iEnd - ii);
+
+        // Streaming
+        for(size_t k=0; k< n; ++k)
+            for(size_t q=0; q< Stencil::Q; ++q)
+                block[q][k] = access.in(ii + k, j, q);
+
+        BodyForce force;
+        collideKernel.kernel(rows, rows, n, rates,
+                            Storage::shifted ? Stencil::w : nullptr,
+                            bodyForce(force, j*numCellsX + ii));
+
+        for(size_t k=0; k< n; ++k)
+            for(size_t q=0; q< Stencil::Q; ++q)
+                access.out(ii + k, j, q) = block[q][k];
     }
+}
+
+template<typename Layout, typename Storage>
+template<typename Access>
+void Simulation<Layout, Storage>::sweep(const Access& access){
+
+    const CollisionRates rates = collisionRates(relaxRate, smagorinsky);
+
+    // The rows are distributed in static slabs over the threads, like in Lattice::init().
+    // Every location is written by exactly one cell in all propagations, so no
+    // synchronisation is needed inside a sweep.
+    #pragma omp parallel
+    {
+        size_t slabBegin, slabEnd;
+        threadSlab(numCellsY - 2, slabBegin, slabEnd);
+        slabBegin += 1;
+        slabEnd += 1;
+
+        // Each slab is traversed tile by tile, a tile row by row
+        const size_t tx = (tileX > 0) ? tileX : numCellsX - 2;
+        const size_t ty = (tileY > 0) ? tileY : slabEnd - slabBegin;
 
-    std::cout << "Period BC's set successfully\n";
+        for(size_t jj= slabBegin; jj< slabEnd; jj+= ty){
+
+            const size_t jEnd = std::min(jj + ty, slabEnd);
+
+            for(size_t ii=1; ii< numCellsX - 1; ii+= tx){
+
+                const size_t iEnd = std::min(ii + tx, numCellsX - 1);
+
+                for(size_t j=jj; j< jEnd; ++j)
+                    sweepRow(access, j, ii, iEnd, rates);
+            }
+        }
+    }
 }
 
-void Simulation::setNoSlipBCs(){
 
-    //Down ghost layer
-    size_t j_src = 1U;
-    size_t j_dest = 0U;
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::wavefrontSteps(const size_t& k){
+
+    const CollisionRates rates = collisionRates(relaxRate, smagorinsky);
+    const size_t lastRow = numCellsY - 2;
+    const size_t fluidX = numCellsX - 2;
 
-    // The for loop are written seperately to utilise cache lines effectively
-    for(size_t i=1; i< numCellsX - 1; ++i) {
+    // Level s of the pass (s time steps done) lives in buffer[s % 2]
+    const View buffer[2] = {view(*src), view(*dest)};
 
-        (*src)(i-1, j_dest, NE) =  (*src)(i, j_src, SW);
-        (*src)(i, j_dest, N) =  (*src)(i, j_src, S);
-        (*src)(i+1, j_dest, NW) =  (*src)(i, j_src, SE);
+    // Rows are split into chunks if there are more threads than levels
+    const size_t chunks = std::max(size_t(1), (size_t(numThreads()) + k - 1) / k);
+
+    #pragma omp parallel
+    {
+        // In iteration r step s updates row r - 2*s. It reads rows r - 2*s - 1 ... r - 2*s + 1 of
+        // level s, which were done in iteration r - 1 at the latest. With this lag of two rows all
+        // updates of one iteration are independent, and a row of level s - 1 is overwritten by
+        // level s + 1 only after all three rows of level s depending on it are done.
+        for(size_t r=1; r< lastRow + 2*k - 1; ++r){
+
+            #pragma omp for schedule(static)
+            for(size_t item=0; item< k * chunks; ++item){
+
+                const size_t s = item / chunks;
+                const size_t c = item % chunks;
+                if(r < 2*s + 1 || r - 2*s > lastRow)
+                    continue;
+
+                const size_t iBegin = 1 + c * fluidX / chunks;
+                const size_t iEnd = 1 + (c + 1) * fluidX / chunks;
+
+                sweepRow(PullAccess<false>{buffer[s % 2], buffer[(s + 1) % 2]}, r - 2*s, iBegin, iEnd, rates);
+            }
+
+        }
     }
 
-    //Top Ghost layer
-    j_src = numCellsY - 2;
-    j_dest = numCellsY - 1;
+    // Level k is in src again after an even no. of steps
+    if(k % 2 == 1)
+        std::swap(src, dest);
 
-    for(size_t i=1; i< numCellsX - 1; ++i) {
+    timeStep += k;
+}
 
-        (*src)(i-1, j_dest, SE) =  (*src)(i, j_src, NW);
-        (*src)(i, j_dest, S) =  (*src)(i, j_src, N);
-        (*src)(i+1, j_dest, SW) =  (*src)(i, j_src, NE);
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::setTemporalBlocking(const size_t& k){
+
+    if(k > 1 && propagation != twoLattice) {
+        LOG_WARNING("Temporal blocking needs two lattices, using single time steps");
+        this->blockSteps = 1;
+        return;
     }
 
-    std::cout << "Reflective BC's set successfully\n";
+    this->blockSteps = std::max(size_t(1), k);
+}
+
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::setAcceleration(const real& ax, const real& ay){
+
+    this->accX = ax;
+    this->accY = ay;
+    LOG_INFO("Body acceleration :(" << ax << ", " << ay << ")");
+}
+
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::setAccelerationField(const std::vector<real>& ax, const std::vector<real>& ay){
+
+    assert(ax.size() == numCellsX * numCellsY && ay.size() == numCellsX * numCellsY);
+    this->accFieldX = ax;
+    this->accFieldY = ay;
+}
+
+template<typename Layout, typename Storage>
+const BodyForce* Simulation<Layout, Storage>::bodyForce(BodyForce& force, const size_t& cell) const{
 
+    const bool field = !accFieldX.empty();
+    if(accX == 0.0 && accY == 0.0 && !field)
+        return nullptr;
+
+    force.x = accX;
+    force.y = accY;
+    force.fieldX = field ? &accFieldX[cell] : nullptr;
+    force.fieldY = field ? &accFieldY[cell] : nullptr;
+    return &force;
 }
 
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::macroscopicFields(FieldSnapshot& snapshot, const size_t& spacing){
+
+    assert(spacing > 0);
+
+    // A partial block at the end of a row or column is averaged over its cells
+    snapshot.resize((numCellsX - 2 + spacing - 1) / spacing, (numCellsY - 2 + spacing - 1) / spacing, spacing);
+    snapshot.timeStep = timeStep;
+
+    // The f_q's streaming into the cells are those the next collision starts from, whatever
+    // the propagation (see incoming()). The bounce back links among them are filled first.
+    setNoSlipBCs();
+
+    if(propagation == twoLattice)
+        macroscopicRows(PullAccess<false>{view(*src), view(*dest)}, snapshot);
+    else if(propagation == esoTwist)
+        macroscopicRows(EsoTwistAccess<false>{view(*src), twistSlot}, snapshot);
+    else if(timeStep % 2 == 0)
+        macroscopicRows(AAEvenAccess<false>{view(*src)}, snapshot);
+    else
+        macroscopicRows(AAOddAccess<false>{view(*src)}, snapshot);
+}
+
+template<typename Layout, typename Storage>
+template<typename Access>
+void Simulation<Layout, Storage>::macroscopicRows(const Access& access, FieldSnapshot& snapshot) const{
+
+    const bool field = !accFieldX.empty();
+    const size_t spacing = snapshot.spacing;
+
+    // The first and last column pull across the periodic boundary
+    const auto wrapped = access.periodic();
+
+    #pragma omp parallel for schedule(static)
+    for(size_t row=0; row< snapshot.sizeY; ++row){
+
+        // Sums of density and velocity and the no. of fluid cells of the blocks of the row
+        std::vector<real> sum(3 * snapshot.sizeX, 0.0);
+        std::vector<size_t> count(snapshot.sizeX, 0);
+
+        const size_t jEnd = std::min(1 + (row + 1)*spacing, numCellsY - 1);
+
+        for(size_t j=1 + row*spacing; j< jEnd; ++j)
+            for(size_t i=1; i< numCellsX - 1; ++i){
+
+                if(!flags.isFluid(i, j))
+                    continue;
+
+                const bool edge = i == 1 || i == numCellsX - 2;
+
+                real rho = 0.0, ux = 0.0, uy = 0.0;
+                for(size_t q=0; q< Stencil::Q; ++q){
+                    const real f = Storage::load(edge ? wrapped.in(i, j, q) : access.in(i, j, q), Stencil::w[q]);
+                    rho += f;
+                    ux += Stencil::cx[q] * f;
+                    uy += Stencil::cy[q] * f;
+                }
+
+                const real ax = accX + (field ? accFieldX[j*numCellsX + i] : 0.0);
+                const real ay = accY + (field ? accFieldY[j*numCellsX + i] : 0.0);
+
+                const size_t block = (i-1) / spacing;
+                sum[3*block] += rho;
+                sum[3*block + 1] += ux / rho + 0.5 * ax;
+                sum[3*block + 2] += uy / rho + 0.5 * ay;
+                ++count[block];
+            }
+
+        for(size_t block=0; block< snapshot.sizeX; ++block){
+
+            const size_t cell = row*snapshot.sizeX + block;
+            const real n = count[block] > 0 ? real(count[block]) : 1.0;
+
+            snapshot.density[cell] = float(sum[3*block] / n);
+            snapshot.velocity[3*cell] = float(sum[3*block + 1] / n);
+            snapshot.velocity[3*cell + 1] = float(sum[3*block + 2] / n);
+            snapshot.velocity[3*cell + 2] = 0.0f;
+            snapshot.fluid[cell] = count[block] > 0;
+        }
+    }
+}
+
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::setOutput(const std::string& prefix, const size_t& interval, const unsigned& formats, const SeriesSettings& series){
+
+    this->writer = std::make_shared<FieldWriter>(prefix, formats, imageSpeed, 0.0, series);
+    this->outputInterval = std::max(size_t(1), interval);
+    LOG_INFO("Output :" << prefix << " every " << outputInterval << " time steps");
+}
+
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::setImages(const std::string& prefix, const size_t& interval, const ImageField& field, const real& range, const size_t& spacing){
+
+    const size_t longest = std::max(numCellsX, numCellsY) - 2;
+
+    this->imageWriter = std::make_shared<FieldWriter>(prefix, pngImage, field, range);
+    this->imageInterval = std::max(size_t(1), interval);
+    this->imageSpacing = spacing > 0 ? spacing : (longest + MAX_IMAGE_SIZE - 1) / MAX_IMAGE_SIZE;
+    LOG_INFO("Images :" << prefix << " every " << imageInterval << " time steps, " << imageSpacing << " x " << imageSpacing << " cells per pixel");
+}
+
+// Checksum of the obstacle cells, a checkpoint only fits the geometry it was taken with
+static uint64_t geometryChecksum(const FlagField& flags)
+{
+    std::vector<uint8_t> obstacle(flags.sizeX() * flags.sizeY());
+    for(size_t j=0; j< flags.sizeY(); ++j)
+        for(size_t i=0; i< flags.sizeX(); ++i)
+            obstacle[j*flags.sizeX() + i] = flags.isObstacle(i, j);
+
+    return checksum64(obstacle.data(), obstacle.size());
+}
+
+template<typename Layout, typename Storage>
+CheckpointHeader Simulation<Layout, Storage>::stateHeader() const{
+
+    CheckpointHeader header = checkpointHeader();
+
+    header.numCellsX = numCellsX;
+    header.numCellsY = numCellsY;
+    header.numDir = Stencil::Q;
+    header.valueSize = sizeof(value_type);
+    std::strncpy(header.layout, Layout::name(), sizeof(header.layout) - 1);
+    std::strncpy(header.storage, Storage::name(), sizeof(header.storage) - 1);
+    header.propagation = propagation;
+    header.collision = collision;
+    for(size_t q=0; q< Stencil::Q; ++q)
+        header.twistSlot[q] = uint32_t(twistSlot[q]);
+    header.timeStep = timeStep;
+    header.geometryChecksum = geometryChecksum(flags);
+
+    header.nx = nx;
+    header.ny = ny;
+    header.latticeVisc = latticeVisc;
+    header.latticeAcc = latticeAcc;
+    header.relaxRate = relaxRate;
+    header.timeSteps = timeSteps;
+    header.smagorinsky = smagorinsky;
+    header.accX = accX;
+    header.accY = accY;
+
+    return header;
+}
+
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::writeCheckpoint(const std::string& path) const{
+
+    // Two lattices: src holds the state, dest is overwritten by the next step
+    CheckpointHeader header = stateHeader();
+    writeCheckpointFile(path, header, src->data(), Layout::size(numCellsX * numCellsY) * sizeof(value_type));
+
+    LOG_DEBUG("Checkpoint of time step " << timeStep << " written to " << path);
+}
+
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::readCheckpoint(const std::string& path){
+
+    CheckpointReader reader(path);
+    const CheckpointHeader& stored = reader.header();
+    const CheckpointHeader current = stateHeader();
+
+    // The f_q's are copied as they are, so the lattice must be the same
+    std::string error;
+    if(stored.numCellsX != current.numCellsX || stored.numCellsY != current.numCellsY)
+        error = "the lattice has " + std::to_string(stored.numCellsX) + " x " + std::to_string(stored.numCellsY) + " cells";
+    else if(stored.numDir != current.numDir || stored.valueSize != current.valueSize ||
+            std::strncmp(stored.layout, current.layout, sizeof(stored.layout)) != 0 ||
+            std::strncmp(stored.storage, current.storage, sizeof(stored.storage)) != 0)
+        error = std::string("the lattice is ") + stored.layout + ", " + stored.storage;
+    else if(stored.propagation != current.propagation)
+        error = "another propagation";
+    else if(stored.geometryChecksum != current.geometryChecksum)
+        error = "another geometry";
+
+    if(!error.empty())
+        throw std::runtime_error("Checkpoint " + path + " does not fit the simulation: " + error);
+
+    reader.read(src->data(), Layout::size(numCellsX * numCellsY) * sizeof(value_type));
+
+    // The physics may be changed on purpose, e.g. to continue with another viscosity
+    if(stored.relaxRate != current.relaxRate || stored.latticeAcc != current.latticeAcc ||
+       stored.smagorinsky != current.smagorinsky || stored.collision != current.collision ||
+       stored.accX != current.accX || stored.accY != current.accY)
+        LOG_WARNING("Checkpoint " << path << " was taken with relaxRate " << stored.relaxRate << ", latticeAcc " << stored.latticeAcc
+                    << ", " << collisionName(CollisionModel(stored.collision)) << ", Smagorinsky constant " << stored.smagorinsky
+                    << ", acceleration (" << stored.accX << ", " << stored.accY << "), continuing with the settings of this run");
+
+    this->timeStep = stored.timeStep;
+    for(size_t q=0; q< Stencil::Q; ++q)
+        this->twistSlot[q] = stored.twistSlot[q];
+
+    LOG_INFO("Restarted from " << path << " at time step " << timeStep << " of " << timeSteps);
+}
+
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::setCheckpoint(const std::string& path, const size_t& interval){
+
+    this->checkpointPath = path;
+    this->checkpointInterval = std::max(size_t(1), interval);
+    LOG_INFO("Checkpoint :" << path << " every " << checkpointInterval << " time steps");
+}
+
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::setTileSize(const size_t& tx, const size_t& ty){
+
+    this->tileX = tx;
+    this->tileY = ty;
+}
+
+template<typename Layout, typename Storage>
+double Simulation<Layout, Storage>::bytesPerCellUpdate() const{
+
+    // Two lattices: read src, write dest plus the write allocate of dest.
+    // In place: every f_q is read and written once.
+    if(propagation == twoLattice)
+        return 3.0 * Stencil::Q * sizeof(value_type);
+
+    return 2.0 * Stencil::Q * sizeof(value_type);
+}
+
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::autotuneTileSize(){
+
+    if(timeStep != 0) {
+        LOG_WARNING("Tile sizes can only be tuned before the first time step");
+        return;
+    }
+
+    const size_t fluidX = numCellsX - 2;
+    const size_t fluidY = numCellsY - 2;
+
+    // Candidate tile sizes, 0 stands for the whole row / thread slab
+    const size_t widths[] = {16, 32, 64, 128, 256, 512, 0};
+    const size_t heights[] = {4, 16, 64, 0};
+
+    // Enough sweeps per candidate to get a stable timing, an even no. for the AA pattern
+    const double cells = double(fluidCells());
+    const size_t sweeps = 2 * std::max(size_t(1), size_t(5e6 / cells / 2));
+
+    const double streamBW = streamTriadBandwidth();
+
+    LOG_INFO("Tuning tile sizes (" << sweeps << " sweeps each)");
+
+    double bestMLUPS = 0.0;
+    size_t bestX = 0, bestY = 0;
+
+    for(size_t a=0; a< sizeof(widths) / sizeof(widths[0]); ++a){
+
+        if(widths[a] >= fluidX)
+            continue;
+
+        for(size_t b=0; b< sizeof(heights) / sizeof(heights[0]); ++b){
+
+            if(heights[b] >= fluidY)
+                continue;
+
+            setTileSize(widths[a], heights[b]);
+
+            // Warm up
+            stream_Collide();
+            stream_Collide();
+
+            const auto start = std::chrono::steady_clock::now();
+            for(size_t t=0; t< sweeps; ++t)
+                stream_Collide();
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            const double mlups = cells * sweeps / elapsed.count() * 1e-6;
+            const double gbs = mlups * bytesPerCellUpdate() * 1e-3;
+
+            LOG_INFO("Tile " << (widths[a] ? widths[a] : fluidX) << " x "
+                     << (heights[b] ? std::to_string(heights[b]) : std::string("slab")) << " :"
+                     << mlups << " MLUPS, " << gbs << " GB/s (" << 100.0 * gbs / streamBW << "% of STREAM)");
+
+            if(mlups > bestMLUPS) {
+                bestMLUPS = mlups;
+                bestX = widths[a];
+                bestY = heights[b];
+            }
+        }
+    }
+
+    setTileSize(bestX, bestY);
+    LOG_INFO("Selected tile " << (bestX ? bestX : fluidX) << " x "
+             << (bestY ? std::to_string(bestY) : std::string("slab")));
+
+    // The tuning sweeps advanced the state, start over from the initial one
+    initState();
+}
+
+
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::stream_Collide(){
+
+    switch(propagation){
+
+    case twoLattice:
+        // Pull scheme: every fluid cell gathers the populations streaming into it from its
+        // neighbours in src, relaxes them towards equilibrium (BGK) and writes them to dest.
+        sweep(PullAccess<false>{view(*src), view(*dest)});
+
+        // dest holds the new time step now, so it becomes the src of the next one
+        std::swap(src, dest);
+        break;
+
+    case aaPattern:
+        if(timeStep % 2 == 0)
+            sweep(AAEvenAccess<false>{view(*src)});
+        else
+            sweep(AAOddAccess<false>{view(*src)});
+        break;
+
+    case esoTwist:
+        sweep(EsoTwistAccess<false>{view(*src), twistSlot});
+
+        // The twist: f_q is found where f_opposite(q) was before
+        for(size_t q=1; q< Stencil::Q; ++q)
+            if(size_t(Stencil::opposite[q]) > q)
+                std::swap(twistSlot[q], twistSlot[Stencil::opposite[q]]);
+        break;
+    }
+
+    ++timeStep;
+}
+
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::advance(const size_t& steps){
+
+    size_t t = 0;
+
+    // blockSteps time steps per pass over the lattice
+    if(blockSteps > 1)
+        for(; t + blockSteps <= steps; t += blockSteps)
+            wavefrontSteps(blockSteps);
+
+    for(; t< steps; ++t){
+
+        // The periodic BC's and the bounce back at walls and obstacles are done by the sweep
+        stream_Collide();
+    }
+}
+
+template<typename Layout, typename Storage>
+const char* Simulation<Layout, Storage>::collideKernelName() const{
+
+    return collideKernel.name;
+}
+
+
+template<typename Layout, typename Storage>
+void Simulation<Layout, Storage>::runSimulation(){
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // A restarted simulation continues with the time step of the checkpoint
+    const size_t first = std::min(timeStep, timeSteps);
+    size_t numCheckpoints = 0;
+    std::chrono::duration<double> checkpointTime(0.0);
+    std::chrono::duration<double> imageTime(0.0);
+
+    // Frames a series holds beyond the start are replaced by this run's
+    if(writer)
+        writer->continueAfter(timeStep);
+
+    // With output the fields are handed to the writer thread every outputInterval steps, the
+    // downsampled ones for the images every imageInterval steps, a checkpoint is written every
+    // checkpointInterval steps. All at the end as well.
+    for(size_t t=first; t< timeSteps; ){
+
+        size_t next = timeSteps;
+        if(writer)
+            next = std::min(next, (t / outputInterval + 1) * outputInterval);
+        if(imageWriter)
+            next = std::min(next, (t / imageInterval + 1) * imageInterval);
+        if(checkpointInterval > 0)
+            next = std::min(next, (t / checkpointInterval + 1) * checkpointInterval);
+
+        advance(next - t);
+        t = next;
+
+        if(writer && (t % outputInterval == 0 || t == timeSteps)) {
+            macroscopicFields(writer->acquire());
+            writer->submit();
+        }
+
+        // Only the reduction runs on the threads of the time loop, the encoder has its own
+        if(imageWriter && (t % imageInterval == 0 || t == timeSteps)) {
+            const auto imageStart = std::chrono::steady_clock::now();
+            macroscopicFields(imageWriter->acquire(), imageSpacing);
+            imageWriter->submit();
+            imageTime += std::chrono::steady_clock::now() - imageStart;
+        }
+
+        if(checkpointInterval > 0 && (t % checkpointInterval == 0 || t == timeSteps)) {
+            const auto checkpointStart = std::chrono::steady_clock::now();
+            writeCheckpoint(checkpointPath);
+            checkpointTime += std::chrono::steady_clock::now() - checkpointStart;
+            ++numCheckpoints;
+        }
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    // Million lattice (fluid cell) updates per second
+    const double cellUpdates = double(fluidCells()) * double(timeSteps - first);
+
+    const std::string tag = std::string(Layout::name()) + ", " + Storage::name();
+
+    LOG_INFO("Runtime (" << tag << ") :" << elapsed.count() << " s");
+    LOG_INFO("MLUPS (" << tag << ") :" << cellUpdates / elapsed.count() * 1e-6);
+    LOG_INFO("Bandwidth (" << tag << ") :" << cellUpdates * bytesPerCellUpdate() / elapsed.count() * 1e-9 << " GB/s");
+
+    if(writer) {
+        writer->flush();
+        LOG_INFO("Snapshots written :" << writer->snapshotsWritten() << ", time steps waited " << writer->waitTime() << " s for the writer");
+    }
+
+    if(imageWriter) {
+        imageWriter->flush();
+        LOG_INFO("Images rendered :" << imageWriter->snapshotsWritten() << ", time loop spent " << imageTime.count() << " s ("
+                 << 100.0 * imageTime.count() / elapsed.count() << " % of the runtime) on them");
+    }
+
+    if(numCheckpoints > 0)
+        LOG_INFO("Checkpoints written :" << numCheckpoints << " in " << checkpointTime.count() << " s");
+}
 
+// The layouts and storage types the simulation is built for
+#define LBM_INSTANTIATE_SIMULATION(Layout) \
+    template class Simulation<Layout, PlainStorage<double> >; \
+    template class Simulation<Layout, PlainStorage<float> >; \
+    template class Simulation<Layout, ShiftedStorage<float> >;
 
+LBM_INSTANTIATE_SIMULATION(AoS)
+LBM_INSTANTIATE_SIMULATION(SoA)
+LBM_INSTANTIATE_SIMULATION(AoSoA<4>)
+LBM_INSTANTIATE_SIMULATION(AoSoA<8>)
@@ -0,0 +1,316 @@
+#include "SparseSimulation.hpp"
+#include "Parameters.hpp"
+#include "Threading.hpp"
+#include "Log.hpp"
+#include <utility>      // std::swap
+#include <algorithm>    // std::min
+#include <chrono>
+#include <string>
+#include <stdexcept>
+#include <cassert>
+
+static const uint32_t noFluid = uint32_t(-1);
+
+
+template<typename Storage>
+SparseSimulation<Storage>::SparseSimulation(const FlagField& flags, const CollisionModel& model, const real& cs){
+
+    this->numCellsX = flags.sizeX();
+    this->numCellsY = flags.sizeY();
+    this->numFluid = flags.fluidCells();
+    this->timeStep = 0;
+    this->smagorinsky = cs;
+    this->accX = 0.0;
+    this->accY = 0.0;
+    this->outputInterval = 0;
+
+    // The f_q's are addressed with 32 bit indices, noFluid marks the obstacles
+    if(Stencil::Q * numFluid >= size_t(noFluid))
+        throw std::invalid_argument("Can't store " + std::to_string(numFluid) + " fluid cells in the sparse lattice, at most " +
+                                    std::to_string(size_t(noFluid - 1) / Stencil::Q) + " fit its 32 bit indices");
+
+    // The cells of the fluid cells are stored with 32 bit indices as well, however few they are
+    if(numCellsX * numCellsY >= size_t(noFluid))
+        throw std::invalid_argument("Can't index the " + std::to_string(numCellsX) + " x " + std::to_string(numCellsY) +
+                                    " cells of the sparse lattice with 32 bit indices, at most " + std::to_string(size_t(noFluid) - 1) +
+                                    " cells fit");
+
+    LOG_INFO("=============  Sparse lattice =========  ");
+    LOG_INFO("numCellsX :" << numCellsX);
+    LOG_INFO("numCellsY :" << numCellsY);
+    LOG_INFO("Fluid cells :" << numFluid);
+    LOG_INFO("Storage :" << Storage::name());
+    LOG_INFO("Threads :" << numThreads());
+    if(smagorinsky > 0)
+        LOG_INFO("Smagorinsky constant :" << smagorinsky);
+
+    pinThreads();
+
+    // Fluid cells in row major order, so neighbours along x stay next to each other
+    fluidIndex.assign(numCellsX * numCellsY, noFluid);
+    cells.reserve(numFluid);
+
+    for(size_t j=1; j< numCellsY - 1; ++j)
+        for(size_t i=1; i< numCellsX - 1; ++i)
+            if(flags.isFluid(i, j)) {
+                fluidIndex[j*numCellsX + i] = cells.size();
+                cells.push_back(j*numCellsX + i);
+            }
+
+    src.resize(Stencil::Q * numFluid);
+    dest.resize(Stencil::Q * numFluid);
+    neighbour.resize((Stencil::Q - 1) * numFluid);
+
+    init();
+
+    // Where the f_q streaming into cell k comes from
+    #pragma omp parallel for schedule(static)
+    for(size_t k=0; k< numFluid; ++k){
+
+        const size_t i = cells[k] % numCellsX;
+        const size_t j = cells[k] / numCellsX;
+
+        for(size_t q=1; q< Stencil::Q; ++q){
+
+            size_t iFrom = i - Stencil::cx[q];
+            const size_t jFrom = j - Stencil::cy[q];
+
+            // Periodic in x
+            if(iFrom == 0)
+                iFrom = numCellsX - 2;
+            else if(iFrom == numCellsX - 1)
+                iFrom = 1;
+
+            // Halfway bounce back at walls and obstacles: the f_opposite(q) the cell
+            // sent towards the solid neighbour comes back as f_q
+            const uint32_t from = fluidIndex[jFrom*numCellsX + iFrom];
+
+            if(from == noFluid)
+                neighbour[(q-1)*numFluid + k] = Stencil::opposite[q]*numFluid + k;
+            else
+                neighbour[(q-1)*numFluid + k] = q*numFluid + from;
+        }
+    }
+
+    this->collideKernel = selectCollideKernel<value_type>(model, smagorinsky > 0);
+}
+
+
+template<typename Storage>
+void SparseSimulation<Storage>::init(){
+
+    // Same static schedule over the blocks as stream_Collide()
+    const size_t numBlocks = (numFluid + blockSize - 1) / blockSize;
+
+    #pragma omp parallel for schedule(static)
+    for(size_t b=0; b< numBlocks; ++b){
+
+        const size_t kEnd = std::min(numFluid, (b + 1) * blockSize);
+
+        for(size_t q=0; q< Stencil::Q; ++q)
+            for(size_t k=b*blockSize; k< kEnd; ++k){
+                src[q*numFluid + k] = Storage::store(Stencil::w[q], Stencil::w[q]);
+                dest[q*numFluid + k] = Storage::store(Stencil::w[q], Stencil::w[q]);
+                if(q > 0)
+                    neighbour[(q-1)*numFluid + k] = 0;
+            }
+    }
+}
+
+template<typename Storage>
+real SparseSimulation<Storage>::get(const size_t& i, const size_t& j, const size_t& q) const{
+
+    const uint32_t k = fluidIndex[j*numCellsX + i];
+    assert(k != noFluid && q < Stencil::Q);
+
+    return Storage::load(src[q*numFluid + k], Stencil::w[q]);
+}
+
+template<typename Storage>
+void SparseSimulation<Storage>::set(const size_t& i, const size_t& j, const size_t& q, const real& f){
+
+    const uint32_t k = fluidIndex[j*numCellsX + i];
+    assert(k != noFluid && q < Stencil::Q);
+
+    src[q*numFluid + k] = Storage::store(f, Stencil::w[q]);
+}
+
+template<typename Storage>
+void SparseSimulation<Storage>::setAcceleration(const real& ax, const real& ay){
+
+    this->accX = ax;
+    this->accY = ay;
+    LOG_INFO("Body acceleration :(" << ax << ", " << ay << ")");
+}
+
+template<typename Storage>
+void SparseSimulation<Storage>::setAccelerationField(const std::vector<real>& ax, const std::vector<real>& ay){
+
+    assert(ax.size() == numCellsX * numCellsY && ay.size() == numCellsX * numCellsY);
+
+    // Compacted to the fluid cells, in the order of the f_q's
+    accFieldX.resize(numFluid);
+    accFieldY.resize(numFluid);
+    for(size_t k=0; k< numFluid; ++k){
+        accFieldX[k] = ax[cells[k]];
+        accFieldY[k] = ay[cells[k]];
+    }
+}
+
+template<typename Storage>
+void SparseSimulation<Storage>::macroscopicFields(FieldSnapshot& snapshot) const{
+
+    snapshot.resize(numCellsX - 2, numCellsY - 2);
+    snapshot.timeStep = timeStep;
+
+    // Obstacles stay 0
+    std::fill(snapshot.density.begin(), snapshot.density.end(), 0.0f);
+    std::fill(snapshot.velocity.begin(), snapshot.velocity.end(), 0.0f);
+    std::fill(snapshot.fluid.begin(), snapshot.fluid.end(), 0);
+
+    const bool field = !accFieldX.empty();
+
+    // Moments of the f_q's the next collision pulls, as in Simulation
+    #pragma omp parallel for schedule(static)
+    for(size_t k=0; k< numFluid; ++k){
+
+        real f = Storage::load(src[k], Stencil::w[0]);
+        real rho = f, ux = 0.0, uy = 0.0;
+
+        for(size_t q=1; q< Stencil::Q; ++q){
+            f = Storage::load(src[neighbour[(q-1)*numFluid + k]], Stencil::w[q]);
+            rho += f;
+            ux += Stencil::cx[q] * f;
+            uy += Stencil::cy[q] * f;
+        }
+
+        const real ax = accX + (field ? accFieldX[k] : 0.0);
+        const real ay = accY + (field ? accFieldY[k] : 0.0);
+
+        const size_t i = cells[k] % numCellsX;
+        const size_t j = cells[k] / numCellsX;
+        const size_t cell = (j-1)*snapshot.sizeX + (i-1);
+
+        snapshot.density[cell] = float(rho);
+        snapshot.velocity[3*cell] = float(ux / rho + 0.5 * ax);
+        snapshot.velocity[3*cell + 1] = float(uy / rho + 0.5 * ay);
+        snapshot.fluid[cell] = 1;
+    }
+}
+
+template<typename Storage>
+void SparseSimulation<Storage>::setOutput(const std::string& prefix, const size_t& interval, const unsigned& formats, const SeriesSettings& series){
+
+    this->writer = std::make_shared<FieldWriter>(prefix, formats, imageSpeed, 0.0, series);
+    this->outputInterval = std::max(size_t(1), interval);
+    LOG_INFO("Output :" << prefix << " every " << outputInterval << " time steps");
+}
+
+template<typename Storage>
+void SparseSimulation<Storage>::stream_Collide(){
+
+    const CollisionRates rates = collisionRates(relaxRate, smagorinsky);
+    const real* shift = Storage::shifted ? Stencil::w : nullptr;
+    const bool field = !accFieldX.empty();
+    const bool forced = accX != 0.0 || accY != 0.0 || field;
+    const size_t numBlocks = (numFluid + blockSize - 1) / blockSize;
+
+    const value_type* from = src.data();
+    value_type* to = dest.data();
+    const uint32_t* index = neighbour.data();
+
+    #pragma omp parallel for schedule(static)
+    for(size_t b=0; b< numBlocks; ++b){
+
+        const size_t kBegin = b * blockSize;
+        const size_t n = std::min(numFluid, kBegin + blockSize) - kBegin;
+
+        // Streaming: gather the incoming f_q's of the block into contiguous rows
+        alignas(64) value_type gathered[Stencil::Q - 1][blockSize];
+
+        const value_type* in[Stencil::Q];
+        value_type* out[Stencil::Q];
+
+        in[0] = from + kBegin;
+        out[0] = to + kBegin;
+
+        for(size_t q=1; q< Stencil::Q; ++q){
+
+            const uint32_t* idx = index + (q-1)*numFluid + kBegin;
+            for(size_t k=0; k< n; ++k)
+                gathered[q-1][k] = from[idx[k]];
+
+            in[q] = gathered[q-1];
+            out[q] = to + q*numFluid + kBegin;
+        }
+
+        // Body force of the block
+        BodyForce force = {accX, accY, 0, 0};
+        if(field) {
+            force.fieldX = &accFieldX[kBegin];
+            force.fieldY = &accFieldY[kBegin];
+        }
+
+        collideKernel.kernel(in, out, n, rates, shift, forced ? &force : nullptr);
+    }
+
+    std::swap(src, dest);
+    ++timeStep;
+}
+
+template<typename Storage>
+void SparseSimulation<Storage>::advance(const size_t& steps){
+
+    for(size_t t=0; t< steps; ++t)
+        stream_Collide();
+}
+
+template<typename Storage>
+double SparseSimulation<Storage>::bytesPerCellUpdate() const{
+
+    // Read src, write dest plus the write allocate of dest, and read the indices
+    return 3.0 * Stencil::Q * sizeof(value_type) + (Stencil::Q - 1) * sizeof(uint32_t);
+}
+
+template<typename Storage>
+void SparseSimulation<Storage>::runSimulation(){
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // With output the fields are handed to the writer thread every outputInterval steps
+    const size_t interval = writer ? outputInterval : timeSteps;
+
+    // Frames a series holds beyond the start are replaced by this run's
+    if(writer)
+        writer->continueAfter(timeStep);
+
+    for(size_t t=0; t< timeSteps; t += interval){
+
+        advance(std::min(interval, timeSteps - t));
+
+        if(writer) {
+            macroscopicFields(writer->acquire());
+            writer->submit();
+        }
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    // Million lattice (fluid cell) updates per second
+    const double cellUpdates = double(numFluid) * double(timeSteps);
+    const std::string tag = std::string("sparse, ") + Storage::name();
+
+    LOG_INFO("Runtime (" << tag << ") :" << elapsed.count() << " s");
+    LOG_INFO("MLUPS (" << tag << ") :" << cellUpdates / elapsed.count() * 1e-6);
+    LOG_INFO("Bandwidth (" << tag << ") :" << cellUpdates * bytesPerCellUpdate() / elapsed.count() * 1e-9 << " GB/s");
+
+    if(writer) {
+        writer->flush();
+        LOG_INFO("Snapshots written :" << writer->snapshotsWritten() << ", time steps waited " << writer->waitTime() << " s for the writer");
+    }
+}
+
+// The storage types the sparse lattice is built for
+template class SparseSimulation<PlainStorage<double> >;
+template class SparseSimulation<PlainStorage<float> >;
+template class SparseSimulation<ShiftedStorage<float> >;
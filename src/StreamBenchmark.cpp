@@ -0,0 +1,49 @@
+#include "StreamBenchmark.hpp"
+#include "LatticeAllocator.hpp"
+#include "Log.hpp"
+#include <vector>
+#include <chrono>
+
+double streamTriadBandwidth(const size_t& n)
+{
+    static double bandwidth = 0.0;
+    if(bandwidth > 0.0)
+        return bandwidth;
+
+    // Uninitialised, so that the first touch below happens in parallel
+    std::vector<double, LatticeAllocator<double> > a(n), b(n), c(n);
+
+    #pragma omp parallel for schedule(static)
+    for(size_t i=0; i< n; ++i) {
+        a[i] = 0.0;
+        b[i] = 1.0;
+        c[i] = 2.0;
+    }
+
+    const double s = 3.0;
+    double best = 0.0;
+
+    for(int rep=0; rep< 5; ++rep) {
+
+        const auto start = std::chrono::steady_clock::now();
+
+        #pragma omp parallel for schedule(static)
+        for(size_t i=0; i< n; ++i)
+            a[i] = b[i] + s * c[i];
+
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        const double gbs = 3.0 * sizeof(double) * n / elapsed.count() * 1e-9;
+        if(gbs > best)
+            best = gbs;
+    }
+
+    // Keep the compiler from dropping the loops
+    if(a[n / 2] != b[n / 2] + s * c[n / 2])
+        LOG_ERROR("STREAM triad gave wrong results");
+
+    bandwidth = best;
+    LOG_INFO("STREAM triad :" << bandwidth << " GB/s");
+
+    return bandwidth;
+}
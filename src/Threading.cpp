@@ -0,0 +1,96 @@
+#include "Threading.hpp"
+#include "Log.hpp"
+#include <vector>
+#include <cstdlib>      // getenv
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(_OPENMP) && defined(__linux__)
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+
+int numThreads()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+void threadSlab(const size_t& n, size_t& begin, size_t& end)
+{
+#ifdef _OPENMP
+    const size_t numT = omp_get_num_threads();
+    const size_t tid = omp_get_thread_num();
+#else
+    const size_t numT = 1, tid = 0;
+#endif
+
+    // Same split as libgomp: the first n % numT threads get one iteration more
+    const size_t chunk = n / numT;
+    const size_t rest = n % numT;
+
+    if(tid < rest) {
+        begin = tid * (chunk + 1);
+        end = begin + chunk + 1;
+    }
+    else {
+        begin = tid * chunk + rest;
+        end = begin + chunk;
+    }
+}
+
+void pinThreads()
+{
+#if defined(_OPENMP) && defined(__linux__)
+    // The CPUs the process may run on, taken before the first pinning narrows the mask of the
+    // master thread. New workers inherit the master's mask, so the threads are pinned again
+    // whenever their number changed (e.g. a rising thread count in lbm_bench).
+    static cpu_set_t available;
+    static std::vector<int> cpus;
+    static int pinnedThreads = -1;
+
+    if(pinnedThreads < 0) {
+        pinnedThreads = 0;
+
+        if(std::getenv("OMP_PROC_BIND") || std::getenv("OMP_PLACES") || std::getenv("GOMP_CPU_AFFINITY"))
+            return;
+        if(sched_getaffinity(0, sizeof(available), &available) != 0)
+            return;
+
+        for(int cpu=0; cpu< CPU_SETSIZE; ++cpu)
+            if(CPU_ISSET(cpu, &available))
+                cpus.push_back(cpu);
+    }
+
+    if(cpus.empty() || numThreads() == pinnedThreads)
+        return;
+
+    pinnedThreads = numThreads();
+
+    // Pinned round robin, several threads would share a CPU for the whole run. The threads of
+    // an earlier pinning get all the CPUs back.
+    if(size_t(numThreads()) > cpus.size()) {
+        LOG_WARNING(numThreads() << " threads for " << cpus.size() << " CPUs, the threads are not pinned");
+
+        #pragma omp parallel
+        pthread_setaffinity_np(pthread_self(), sizeof(available), &available);
+        return;
+    }
+
+    #pragma omp parallel
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[omp_get_thread_num()], &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    LOG_INFO("Pinned " << numThreads() << " threads to " << cpus.size() << " CPUs");
+#endif
+}
@@ -23,11 +23,32 @@ GrayScaleImage::GrayScaleImage( const std::string & pngFilename )
       throw std::invalid_argument( std::string( "Error while loading PNG file: " ) + lodepng_error_text(error)  );
 }
 
-void GrayScaleImage::save( const std::string & pngFilename )
+void GrayScaleImage::save( const std::string & pngFilename, bool fast )
 {
-    unsigned error = lodepng::encode( pngFilename, image_,
-                                      int( size_[0] ), int( size_[1] ),
-                                      LCT_GREY, 8 );
+    unsigned error = 0;
+
+    if ( fast )
+    {
+      lodepng::State state;
+      state.info_raw.colortype = LCT_GREY;
+      state.info_raw.bitdepth = 8;
+      state.info_png.color.colortype = LCT_GREY;
+      state.info_png.color.bitdepth = 8;
+      state.encoder.auto_convert = LAC_NO;
+      state.encoder.filter_strategy = LFS_MINSUM;
+      state.encoder.zlibsettings.windowsize = 512;
+      state.encoder.zlibsettings.nicematch = 32;
+      state.encoder.zlibsettings.lazymatching = 0;
+
+      std::vector<unsigned char> png;
+      error = lodepng::encode( png, image_, size_[0], size_[1], state );
+      if ( !error )
+        error = lodepng_save_file( png.empty() ? 0 : &png[0], png.size(), pngFilename.c_str() );
+    }
+    else
+      error = lodepng::encode( pngFilename, image_,
+                               int( size_[0] ), int( size_[1] ),
+                               LCT_GREY, 8 );
 
     if ( error )
       throw std::invalid_argument( std::string( "Error while loading PNG file: " ) + lodepng_error_text(error)  );
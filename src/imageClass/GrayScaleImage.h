@@ -24,7 +24,9 @@ public:
   GrayScaleImage( const std::string & pngFilename );
 
   /// Save current image to png file
-  void save( const std::string & pngFilename );
+  /// fast: small LZ77 window without lazy matching, for images written while a simulation
+  /// runs. Encoding is about 3 times faster, the files are slightly larger.
+  void save( const std::string & pngFilename, bool fast=false );
 
   /// Returns a resized version the image.
   GrayScaleImage getResizedImage( unsigned int newWidth, unsigned int newHeight, bool bilinear=true ) const;
@@ -0,0 +1,35 @@
+#ifndef DEVIATION_HPP
+#define DEVIATION_HPP
+
+#include "FieldWriter.hpp"
+#include <cmath>      // std::fabs
+#include <algorithm>  // std::max
+
+// Largest deviation of the density and velocity of fields from those of reference in the
+// fluid cells, relative to the largest value of the reference (1 for the density, the
+// maximum speed for the velocity). Shared by the consistency checks.
+inline double deviation(const FieldSnapshot& reference, const FieldSnapshot& fields)
+{
+    const size_t numCells = reference.sizeX * reference.sizeY;
+    if(fields.sizeX != reference.sizeX || fields.sizeY != reference.sizeY)
+        return HUGE_VAL;
+
+    double maxSpeed = 0.0;
+    for(size_t c=0; c< numCells; ++c)
+        maxSpeed = std::max(maxSpeed, double(std::fabs(reference.velocity[3*c])) + std::fabs(reference.velocity[3*c + 1]));
+
+    double worst = 0.0;
+    for(size_t c=0; c< numCells; ++c){
+
+        if(!reference.fluid[c])
+            continue;
+
+        worst = std::max(worst, double(std::fabs(fields.density[c] - reference.density[c])));
+        for(size_t d=0; d< 2; ++d)
+            worst = std::max(worst, std::fabs(fields.velocity[3*c + d] - reference.velocity[3*c + d]) / maxSpeed);
+    }
+
+    return worst;
+}
+
+#endif
@@ -0,0 +1,451 @@
+#include "Lattice.hpp"
+#include "Parameters.hpp"
+#include "Simulation.hpp"
+#include "SparseSimulation.hpp"
+#include "Threading.hpp"
+#include "Log.hpp"
+#include <cstdio>     // sscanf
+#include <cstdlib>    // setenv, unsetenv, strtol, strtod
+#include <cerrno>
+#include <climits>    // INT_MAX
+#include <cmath>      // std::sqrt, std::isfinite
+#include <algorithm>  // std::sort
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+real nx, ny;
+real latticeVisc, latticeAcc;
+real relaxRate; //relaxation rate
+size_t timeSteps;
+
+
+// Benchmark of the stream/collide sweeps. Every combination of the given grid sizes, thread
+// counts, layouts, propagations, storage types, collision operators and collide kernels is run for a fixed no. of
+// time steps, after some warm-up steps, and repeated. The physical parameters (relaxation rate)
+// are the ones of the chosen scenario, so the runs are reproducible.
+
+struct BenchConfig {
+    std::string scenario;
+    std::vector<std::pair<size_t, size_t> > sizes;   // fluid cells in x and y
+    std::vector<int> threads;
+    std::vector<std::string> layouts;
+    std::vector<std::string> propagations;
+    std::vector<std::string> storages;
+    std::vector<std::string> collisions;
+    real smagorinsky;                     // C_s of the LES, 0 for none
+    std::string forcing;                  // none, constant or field
+    std::vector<std::string> kernels;     // auto or a value of LBM_KERNEL
+    std::string geometry;                 // none, cylinder or a png mask
+    size_t steps;
+    size_t warmup;
+    size_t reps;
+    std::string json;                     // output file, empty for none
+};
+
+struct BenchResult {
+    size_t dimX, dimY;
+    size_t fluidCells;
+    int threads;
+    std::string layout, propagation, storage, collision, kernel;
+    double bytesPerCell;
+    std::vector<double> mlups;            // one value per repetition
+
+    double mean, stddev, min, max, median;
+};
+
+
+static std::vector<std::string> split(const std::string& list)
+{
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+
+    while(std::getline(ss, item, ','))
+        if(!item.empty())
+            items.push_back(item);
+
+    return items;
+}
+
+static void computeStats(BenchResult& r)
+{
+    std::vector<double> sorted = r.mlups;
+    std::sort(sorted.begin(), sorted.end());
+
+    const size_t n = sorted.size();
+    r.min = sorted.front();
+    r.max = sorted.back();
+    r.median = (n % 2) ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+
+    r.mean = 0.0;
+    for(size_t k=0; k< n; ++k)
+        r.mean += sorted[k];
+    r.mean /= n;
+
+    r.stddev = 0.0;
+    for(size_t k=0; k< n; ++k)
+        r.stddev += (sorted[k] - r.mean) * (sorted[k] - r.mean);
+    r.stddev = (n > 1) ? std::sqrt(r.stddev / (n - 1)) : 0.0;
+}
+
+
+// Times config.reps runs of config.steps time steps of sim
+template<typename Sim>
+BenchResult measure(const BenchConfig& config, Sim& sim)
+{
+    BenchResult r;
+
+    sim.advance(config.warmup);
+
+    for(size_t rep=0; rep< config.reps; ++rep){
+
+        const auto start = std::chrono::steady_clock::now();
+        sim.advance(config.steps);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        r.mlups.push_back(double(sim.fluidCells()) * double(config.steps) / elapsed.count() * 1e-6);
+    }
+
+    r.fluidCells = sim.fluidCells();
+    r.kernel = sim.collideKernelName();
+    r.bytesPerCell = sim.bytesPerCellUpdate();
+    computeStats(r);
+
+    return r;
+}
+
+// Applies the acceleration of the scenario to sim, as constant or as per cell field
+template<typename Sim>
+void setForcing(const BenchConfig& config, Sim& sim, const FlagField& flags)
+{
+    if(config.forcing == "constant")
+        sim.setAcceleration(latticeAcc, 0.0);
+    else if(config.forcing == "field") {
+        std::vector<real> accX(flags.sizeX() * flags.sizeY(), latticeAcc);
+        std::vector<real> accY(flags.sizeX() * flags.sizeY(), 0.0);
+        sim.setAccelerationField(accX, accY);
+    }
+}
+
+// Sets up the dense lattice with the given layout
+template<typename Layout, typename Storage>
+BenchResult measureDense(const BenchConfig& config, const size_t& dim_x, const size_t& dim_y, const Propagation& propagation,
+                         const CollisionModel& collision, const FlagField& flags)
+{
+    Simulation<Layout, Storage> sim(dim_x, dim_y, propagation, collision, config.smagorinsky);
+    sim.setGeometry(flags);
+    setForcing(config, sim, flags);
+
+    return measure(config, sim);
+}
+
+// Sets up the sparse lattice (always two lattices)
+template<typename Storage>
+BenchResult measureSparse(const BenchConfig& config, const CollisionModel& collision, const FlagField& flags)
+{
+    SparseSimulation<Storage> sim(flags, collision, config.smagorinsky);
+    setForcing(config, sim, flags);
+
+    return measure(config, sim);
+}
+
+// Picks the layout for the given storage type, false if the layout is unknown
+template<typename Storage>
+bool measureLayout(const BenchConfig& config, const std::string& layout, const size_t& dim_x, const size_t& dim_y,
+                   const Propagation& propagation, const CollisionModel& collision, const FlagField& flags, BenchResult& r)
+{
+    if(layout == "aos")         r = measureDense<AoS, Storage>(config, dim_x, dim_y, propagation, collision, flags);
+    else if(layout == "soa")    r = measureDense<SoA, Storage>(config, dim_x, dim_y, propagation, collision, flags);
+    else if(layout == "aosoa4") r = measureDense<AoSoA<4>, Storage>(config, dim_x, dim_y, propagation, collision, flags);
+    else if(layout == "aosoa8") r = measureDense<AoSoA<8>, Storage>(config, dim_x, dim_y, propagation, collision, flags);
+    else if(layout == "sparse") r = measureSparse<Storage>(config, collision, flags);
+    else return false;
+
+    r.dimX = dim_x;
+    r.dimY = dim_y;
+    return true;
+}
+
+
+static void writeJson(const BenchConfig& config, const std::vector<BenchResult>& results)
+{
+    std::ofstream out(config.json.c_str());
+    if(!out) {
+        LOG_ERROR("Could not open " << config.json << " for writing");
+        return;
+    }
+
+    out.precision(10);
+    out << "{\n";
+    out << "  \"benchmark\": \"lbm_bench\",\n";
+    out << "  \"scenario\": \"" << config.scenario << "\",\n";
+    out << "  \"geometry\": \"" << config.geometry << "\",\n";
+    out << "  \"relaxRate\": " << relaxRate << ",\n";
+    out << "  \"smagorinsky\": " << config.smagorinsky << ",\n";
+    out << "  \"forcing\": \"" << config.forcing << "\",\n";
+    out << "  \"steps\": " << config.steps << ",\n";
+    out << "  \"warmup\": " << config.warmup << ",\n";
+    out << "  \"repetitions\": " << config.reps << ",\n";
+    out << "  \"results\": [\n";
+
+    for(size_t k=0; k< results.size(); ++k){
+
+        const BenchResult& r = results[k];
+
+        out << "    {\"nx\": " << r.dimX << ", \"ny\": " << r.dimY << ", \"fluidCells\": " << r.fluidCells << ", \"threads\": " << r.threads
+            << ", \"layout\": \"" << r.layout << "\", \"propagation\": \"" << r.propagation
+            << "\", \"storage\": \"" << r.storage << "\", \"collision\": \"" << r.collision << "\", \"kernel\": \"" << r.kernel << "\",\n";
+        out << "     \"bytesPerCellUpdate\": " << r.bytesPerCell
+            << ", \"mlups\": {\"mean\": " << r.mean << ", \"stddev\": " << r.stddev << ", \"min\": " << r.min
+            << ", \"max\": " << r.max << ", \"median\": " << r.median << ", \"samples\": [";
+        for(size_t s=0; s< r.mlups.size(); ++s)
+            out << (s ? ", " : "") << r.mlups[s];
+        out << "]},\n";
+        out << "     \"gbs\": " << r.mean * r.bytesPerCell * 1e-3 << "}" << (k + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    out << "  ]\n";
+    out << "}\n";
+
+    std::cout << "Results written to " << config.json << std::endl;
+}
+
+
+static void usage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [options]\n"
+              << "  --scenario scenario1|scenario2   physical parameters and default grid (scenario1)\n"
+              << "  --sizes <nx>x<ny>,...             fluid cells (grid of the scenario)\n"
+              << "  --geometry none|cylinder|<png>    obstacles, scaled to the grid (none)\n"
+              << "  --threads <n>,...                 OpenMP threads (all available)\n"
+              << "  --layouts aos,soa,aosoa4,aosoa8,sparse   dense layouts or the sparse lattice (soa)\n"
+              << "  --propagations twolattice,aa,esotwist   (twolattice)\n"
+              << "  --storages double,float,shifted   (double)\n"
+              << "  --collisions bgk,trt,mrt,regularized,cumulant   (bgk)\n"
+              << "  --smagorinsky <C_s>               LES with the Smagorinsky model (0, none)\n"
+              << "  --forcing none|constant|field     acceleration of the scenario (none)\n"
+              << "  --kernels auto,scalar,sse2,avx2,avx512  collide kernels (auto)\n"
+              << "  --steps <n>                       time steps per repetition (100)\n"
+              << "  --warmup <n>                      time steps before the first repetition (10)\n"
+              << "  --reps <n>                        repetitions (5)\n"
+              << "  --json <file>                     machine readable results" << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+// Value of a count option, as in lbm: exits unless it is an integer of at least minimum (and
+// at most INT_MAX, the thread counts are int)
+static size_t count(const std::string& name, const std::string& value, const long& minimum, const char* program)
+{
+    char* end = 0;
+    errno = 0;
+    const long n = std::strtol(value.c_str(), &end, 10);
+
+    if(value.empty() || *end != '\0' || errno == ERANGE || n < minimum || n > INT_MAX) {
+        std::cerr << name << " must be " << (minimum > 0 ? "a positive" : "a non-negative") << " integer, not " << value << std::endl;
+        usage(program);
+    }
+
+    return size_t(n);
+}
+
+// Value of the Smagorinsky constant, as in lbm: exits unless it is a finite number of at least 0
+static real nonNegativeNumber(const std::string& name, const std::string& value, const char* program)
+{
+    char* end = 0;
+    const double x = std::strtod(value.c_str(), &end);
+
+    if(value.empty() || *end != '\0' || !std::isfinite(x) || x < 0.0) {
+        std::cerr << name << " must be a non-negative number, not " << value << std::endl;
+        usage(program);
+    }
+
+    return real(x);
+}
+
+
+int main(int argc, char** argv)
+{
+    BenchConfig config;
+    config.scenario = "scenario1";
+    config.threads.push_back(numThreads());
+    config.layouts.push_back("soa");
+    config.propagations.push_back("twolattice");
+    config.storages.push_back("double");
+    config.collisions.push_back("bgk");
+    config.kernels.push_back("auto");
+    config.smagorinsky = 0.0;
+    config.forcing = "none";
+    config.geometry = "none";
+    config.steps = 100;
+    config.warmup = 10;
+    config.reps = 5;
+
+    std::string sizes;
+
+    for(int a=1; a< argc; a+= 2){
+
+        const std::string opt = argv[a];
+        if(a + 1 >= argc)
+            usage(argv[0]);
+        const std::string value = argv[a + 1];
+
+        if(opt == "--scenario")            config.scenario = value;
+        else if(opt == "--sizes")          sizes = value;
+        else if(opt == "--geometry")       config.geometry = value;
+        else if(opt == "--layouts")        config.layouts = split(value);
+        else if(opt == "--propagations")   config.propagations = split(value);
+        else if(opt == "--storages")       config.storages = split(value);
+        else if(opt == "--collisions")     config.collisions = split(value);
+        else if(opt == "--smagorinsky")    config.smagorinsky = nonNegativeNumber(opt, value, argv[0]);
+        else if(opt == "--forcing")        config.forcing = value;
+        else if(opt == "--kernels")        config.kernels = split(value);
+        else if(opt == "--steps")          config.steps = count(opt, value, 1, argv[0]);
+        else if(opt == "--warmup")         config.warmup = count(opt, value, 0, argv[0]);
+        else if(opt == "--reps")           config.reps = count(opt, value, 1, argv[0]);
+        else if(opt == "--json")           config.json = value;
+        else if(opt == "--threads") {
+            config.threads.clear();
+            const std::vector<std::string> items = split(value);
+            for(size_t k=0; k< items.size(); ++k)
+                config.threads.push_back(int(count(opt, items[k], 1, argv[0])));
+        }
+        else usage(argv[0]);
+    }
+
+    if(config.scenario != "scenario1" && config.scenario != "scenario2")
+        usage(argv[0]);
+    if(config.forcing != "none" && config.forcing != "constant" && config.forcing != "field")
+        usage(argv[0]);
+
+    // Only the warnings and errors of the simulations are shown, the rest would mix with the
+    // results (and cost time in the measurements)
+    if(logLevel() < logWarning)
+        setLogLevel(logWarning);
+
+    // Relaxation rate and grid of the scenario
+    Parameters param(config.scenario);
+    param.calcDomDim();
+
+    if(sizes.empty())
+        config.sizes.push_back(std::make_pair(static_cast<size_t>(nx + 0.5), static_cast<size_t>(ny + 0.5)));
+
+    const std::vector<std::string> sizeItems = split(sizes);
+    for(size_t k=0; k< sizeItems.size(); ++k){
+        size_t sx = 0, sy = 0;
+        if(sscanf(sizeItems[k].c_str(), "%zux%zu", &sx, &sy) != 2 || sx == 0 || sy == 0)
+            usage(argv[0]);
+        config.sizes.push_back(std::make_pair(sx, sy));
+    }
+
+    std::cout << "Benchmark of " << config.scenario << ", geometry " << config.geometry << " (relaxRate " << relaxRate << ", Smagorinsky constant " << config.smagorinsky << ", forcing " << config.forcing << "), " << config.steps
+              << " steps x " << config.reps << " repetitions after " << config.warmup << " warm-up steps" << std::endl;
+
+    std::vector<BenchResult> results;
+
+    for(size_t s=0; s< config.sizes.size(); ++s)
+    for(size_t t=0; t< config.threads.size(); ++t)
+    for(size_t l=0; l< config.layouts.size(); ++l)
+    for(size_t p=0; p< config.propagations.size(); ++p)
+    for(size_t st=0; st< config.storages.size(); ++st)
+    for(size_t c=0; c< config.collisions.size(); ++c)
+    for(size_t k=0; k< config.kernels.size(); ++k){
+
+#ifdef _OPENMP
+        omp_set_num_threads(config.threads[t]);
+#endif
+
+        const std::string& prop = config.propagations[p];
+        Propagation propagation = twoLattice;
+
+        // The sparse lattice has the two lattice propagation only
+        if(config.layouts[l] == "sparse" && p > 0)
+            continue;
+
+        if(prop == "aa") propagation = aaPattern;
+        else if(prop == "esotwist") propagation = esoTwist;
+        else if(prop != "twolattice") {
+            LOG_ERROR("Unknown propagation " << prop << ", choose twolattice, aa or esotwist");
+            exit(EXIT_FAILURE);
+        }
+
+        const std::string& collide = config.collisions[c];
+        CollisionModel collision = bgk;
+
+        if(collide == "trt") collision = trt;
+        else if(collide == "mrt") collision = mrt;
+        else if(collide == "regularized") collision = regularized;
+        else if(collide == "cumulant") collision = cumulant;
+        else if(collide != "bgk") {
+            LOG_ERROR("Unknown collision " << collide << ", choose bgk, trt, mrt, regularized or cumulant");
+            exit(EXIT_FAILURE);
+        }
+
+        // The collide kernel is picked when the simulation is set up
+        if(config.kernels[k] == "auto")
+            unsetenv("LBM_KERNEL");
+        else
+            setenv("LBM_KERNEL", config.kernels[k].c_str(), 1);
+
+        const std::string& storage = config.storages[st];
+        const std::string& layout = config.layouts[l];
+        const size_t dim_x = config.sizes[s].first;
+        const size_t dim_y = config.sizes[s].second;
+
+        FlagField flags(dim_x + 2, dim_y + 2);
+        try {
+            param.buildGeometry(flags, config.geometry);
+        }
+        catch(const std::invalid_argument& e) {
+            LOG_ERROR(e.what());
+            exit(EXIT_FAILURE);
+        }
+
+        BenchResult r;
+        bool layoutKnown = true;
+
+        try {
+            if(storage == "double")       layoutKnown = measureLayout<PlainStorage<double> >(config, layout, dim_x, dim_y, propagation, collision, flags, r);
+            else if(storage == "float")   layoutKnown = measureLayout<PlainStorage<float> >(config, layout, dim_x, dim_y, propagation, collision, flags, r);
+            else if(storage == "shifted") layoutKnown = measureLayout<ShiftedStorage<float> >(config, layout, dim_x, dim_y, propagation, collision, flags, r);
+            else {
+                LOG_ERROR("Unknown storage " << storage << ", choose double, float or shifted");
+                exit(EXIT_FAILURE);
+            }
+        }
+        catch(const std::invalid_argument& e) {
+            LOG_ERROR(e.what());
+            exit(EXIT_FAILURE);
+        }
+
+        if(!layoutKnown) {
+            LOG_ERROR("Unknown layout " << layout << ", choose aos, soa, aosoa4, aosoa8 or sparse");
+            exit(EXIT_FAILURE);
+        }
+
+        r.threads = numThreads();
+        r.layout = layout;
+        r.propagation = config.layouts[l] == "sparse" ? "twolattice" : prop;
+        r.storage = storage;
+        r.collision = collisionName(collision);
+        results.push_back(r);
+
+        std::cout << dim_x << "x" << dim_y << " (" << flags.fluidCells() << " fluid cells) " << r.threads << " threads " << layout << " " << r.propagation << " "
+                  << storage << " " << r.collision << " " << r.kernel << " :" << r.mean << " +- " << r.stddev << " MLUPS (min " << r.min
+                  << ", max " << r.max << "), " << r.bytesPerCell << " B/cell, " << r.mean * r.bytesPerCell * 1e-3
+                  << " GB/s" << std::endl;
+    }
+
+    unsetenv("LBM_KERNEL");
+
+    if(!config.json.empty())
+        writeJson(config, results);
+
+    return 0;
+}
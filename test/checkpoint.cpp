@@ -0,0 +1,128 @@
+#include "Parameters.hpp"
+#include "Simulation.hpp"
+#include "Log.hpp"
+#include "Deviation.hpp"
+#include <cstdio>     // std::remove
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+real nx, ny;
+real latticeVisc, latticeAcc;
+real relaxRate; //relaxation rate
+size_t timeSteps;
+
+
+// Checks the checkpoint / restart of the dense lattice for every propagation: a run stopped
+// after a checkpoint and continued from it in a fresh simulation must end in exactly the state
+// of the run that went through. The odd no. of steps before the checkpoint leaves the AA pattern
+// on its odd parity and the Esoteric Twist with rotated slots. Then a checkpoint with a flipped
+// data byte must be rejected without touching the lattice it is read into.
+// The channel is the one of consistency.cpp.
+
+static const size_t dimX = 64;
+static const size_t dimY = 32;
+static const size_t before = 151;
+static const size_t after = 150;
+
+typedef Simulation<SoA, PlainStorage<double> > Sim;
+
+static void setUp(Sim& sim, const FlagField& flags)
+{
+    sim.setGeometry(flags);
+    sim.setAcceleration(latticeAcc, 0.0);
+}
+
+// Restarted run against the uninterrupted one, true if they agree exactly
+static bool checkRestart(const FlagField& flags, const Propagation& propagation, const std::string& path)
+{
+    FieldSnapshot reference, restarted;
+    {
+        Sim sim(dimX, dimY, propagation);
+        setUp(sim, flags);
+        sim.advance(before + after);
+        sim.macroscopicFields(reference);
+    }
+    {
+        Sim sim(dimX, dimY, propagation);
+        setUp(sim, flags);
+        sim.advance(before);
+        sim.writeCheckpoint(path);
+    }
+
+    Sim sim(dimX, dimY, propagation);
+    setUp(sim, flags);
+    sim.readCheckpoint(path);
+    sim.advance(after);
+    sim.macroscopicFields(restarted);
+
+    return sim.timeStepsDone() == before + after && deviation(reference, restarted) == 0.0;
+}
+
+// Corrupt checkpoint, true if it is rejected and the lattice keeps its state
+static bool checkCorrupt(const FlagField& flags, const Propagation& propagation, const std::string& path)
+{
+    {
+        Sim sim(dimX, dimY, propagation);
+        setUp(sim, flags);
+        sim.advance(before);
+        sim.writeCheckpoint(path);
+    }
+    {
+        // Last byte of the f_q's
+        std::fstream file(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(-1, std::ios::end);
+        const char byte = char(file.get() ^ 0x10);
+        file.seekp(-1, std::ios::end);
+        file.put(byte);
+    }
+
+    Sim sim(dimX, dimY, propagation);
+    setUp(sim, flags);
+    sim.advance(after);
+
+    FieldSnapshot unchanged, fields;
+    sim.macroscopicFields(unchanged);
+
+    try {
+        sim.readCheckpoint(path);
+        return false;
+    }
+    catch(const std::runtime_error&) {
+    }
+
+    sim.macroscopicFields(fields);
+    return sim.timeStepsDone() == after && deviation(unchanged, fields) == 0.0;
+}
+
+
+int main()
+{
+    // Only the failures are of interest, the rejected checkpoint is expected
+    setLogLevel(logOff);
+
+    relaxRate = 1.8;
+    latticeAcc = 1e-5;
+
+    FlagField flags(dimX + 2, dimY + 2);
+    flags.addCylinder(16.0, 15.3, 5.0);
+
+    const std::string path = "checkpoint_check.lbmc";
+    const Propagation propagations[] = {twoLattice, aaPattern, esoTwist};
+    const char* const names[] = {"twolattice", "aa", "esotwist"};
+
+    bool passed = true;
+    for(size_t p=0; p< 3; ++p){
+
+        const bool restart = checkRestart(flags, propagations[p], path);
+        const bool corrupt = checkCorrupt(flags, propagations[p], path);
+        passed = passed && restart && corrupt;
+
+        std::cout << (restart ? "ok     " : "FAILED ") << names[p] << " :restart after " << before << " steps" << std::endl;
+        std::cout << (corrupt ? "ok     " : "FAILED ") << names[p] << " :corrupt checkpoint rejected, lattice unchanged" << std::endl;
+    }
+
+    std::remove(path.c_str());
+    return passed ? 0 : 1;
+}
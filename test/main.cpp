@@ -1,31 +1,231 @@
 #include "Lattice.hpp"
 #include "Parameters.hpp"
 #include "Simulation.hpp"
+#include "SparseSimulation.hpp"
+#include "Log.hpp"
+#include <cstdio>     // sscanf
+#include <cstdlib>    // strtol, strtod
+#include <cerrno>
+#include <cmath>      // std::isfinite
+#include <algorithm>  // std::max, std::find
+#include <iterator>   // std::begin, std::end
+#include <map>
+#include <string>
+#include <fstream>    // std::ifstream
+#include <stdexcept>
 
 real nx, ny;
 real latticeVisc, latticeAcc;
 real relaxRate; //relaxation rate
+size_t timeSteps;
 
 
+// Options of a run, see usage
+struct RunConfig {
+    size_t dimX, dimY;
+    Propagation propagation;
+    CollisionModel collision;
+    real smagorinsky;                     // C_s of the LES, 0 for none
+    size_t tileX, tileY;                  // 0 x 0 without tiling
+    bool autotune;                        // picks the tile size itself
+    size_t blockSteps;                    // time steps per pass over the lattice (temporal blocking)
+
+    std::string output;                   // prefix of the fields, none for no output
+    size_t outputInterval;
+    unsigned outputFormats;
+    SeriesSettings series;                // error bounds of the compressed series
+
+    std::string checkpoint;               // continued from if it exists, none for no checkpoints
+    size_t checkpointInterval;
+
+    std::string images;                   // prefix of the png images, none for no images
+    size_t imageInterval;
+    ImageField imageField;
+};
+
+// Runs the whole scenario on a lattice with the given memory layout and storage type
+template<typename Layout, typename Storage>
+void run(const RunConfig& config, const FlagField& flags)
+{
+    Simulation<Layout, Storage> sim(config.dimX, config.dimY, config.propagation, config.collision, config.smagorinsky);
+    sim.setGeometry(flags);
+    sim.setTemporalBlocking(config.blockSteps);
+
+    // The channel is driven by the acceleration of the scenario
+    sim.setAcceleration(latticeAcc, 0.0);
+
+    if(config.output != "none")
+        sim.setOutput(config.output, config.outputInterval, config.outputFormats, config.series);
+
+    if(config.images != "none")
+        sim.setImages(config.images, config.imageInterval, config.imageField);
+
+    if(config.autotune)
+        sim.autotuneTileSize();
+    else
+        sim.setTileSize(config.tileX, config.tileY);
+
+    // After the tuning, which starts over from the initial state
+    if(config.checkpoint != "none") {
+        if(std::ifstream(config.checkpoint.c_str()).good())
+            sim.readCheckpoint(config.checkpoint);
+        sim.setCheckpoint(config.checkpoint, config.checkpointInterval);
+    }
+
+    sim.runSimulation();
+}
+
+// Runs the whole scenario on the fluid cells only, with the given storage type
+template<typename Storage>
+void runSparse(const RunConfig& config, const FlagField& flags)
+{
+    SparseSimulation<Storage> sim(flags, config.collision, config.smagorinsky);
+    sim.setAcceleration(latticeAcc, 0.0);
+
+    if(config.output != "none")
+        sim.setOutput(config.output, config.outputInterval, config.outputFormats, config.series);
+
+    sim.runSimulation();
+}
+
+// Picks the sparse lattice or the layout of the dense one (checked by main) for the given
+// storage type
+template<typename Storage>
+void runLattice(const bool& sparse, const std::string& layout, const RunConfig& config, const FlagField& flags)
+{
+    if(sparse)                  runSparse<Storage>(config, flags);
+    else if(layout == "aos")    run<AoS, Storage>(config, flags);
+    else if(layout == "soa")    run<SoA, Storage>(config, flags);
+    else if(layout == "aosoa4") run<AoSoA<4>, Storage>(config, flags);
+    else                        run<AoSoA<8>, Storage>(config, flags);
+}
+
+
+static const char* const optionNames[] = {
+    "layout", "propagation", "tiling", "block-steps", "storage", "geometry", "lattice", "collision", "smagorinsky",
+    "output", "output-interval", "output-format", "error-bound", "density-error", "velocity-error", "checkpoint", "checkpoint-interval",
+    "images", "image-interval", "image-field"
+};
+
+// Value of an option that counts time steps, exits unless it is a positive integer
+static size_t positiveInteger(const std::string& name, const std::string& value)
+{
+    char* end = 0;
+    errno = 0;
+    const long n = std::strtol(value.c_str(), &end, 10);
+
+    if(value.empty() || *end != '\0' || errno == ERANGE || n <= 0) {
+        LOG_ERROR("--" << name << " must be a positive integer, not " << value);
+        exit(EXIT_FAILURE);
+    }
+
+    return size_t(n);
+}
+
+// Value of an option that is a real number, exits unless it is finite and positive (or at
+// least 0 if zero is allowed)
+static real number(const std::string& name, const std::string& value, const bool& zeroAllowed)
+{
+    char* end = 0;
+    const double x = std::strtod(value.c_str(), &end);
+
+    if(value.empty() || *end != '\0' || !std::isfinite(x) || x < 0.0 || (x == 0.0 && !zeroAllowed)) {
+        LOG_ERROR("--" << name << " must be a " << (zeroAllowed ? "non-negative" : "positive") << " number, not " << value);
+        exit(EXIT_FAILURE);
+    }
+
+    return real(x);
+}
+
+static void usage(const char* name)
+{
+    LOG_ERROR("Usage: " << name << " scenario1|scenario2 [--<option> <value> | --<option>=<value> ...]\n"
+              << "  --layout aos|soa|aosoa4|aosoa8               memory layout of the dense lattice (aos)\n"
+              << "  --propagation twolattice|aa|esotwist         (twolattice)\n"
+              << "  --tiling none|auto|<width>x<height>          tiles of the sweep (none)\n"
+              << "  --block-steps <n>                            time steps per pass, two lattices only (1)\n"
+              << "  --storage double|float|shifted               type of the f_q's (double)\n"
+              << "  --geometry cylinder|none|<mask.png>          obstacles, a mask is scaled to the grid (cylinder)\n"
+              << "  --lattice auto|dense|sparse                  sparse stores the fluid cells only, no checkpoints or images (auto)\n"
+              << "  --collision bgk|trt|mrt|regularized|cumulant (bgk)\n"
+              << "  --smagorinsky <C_s>                          LES with the Smagorinsky model (0, none)\n"
+              << "  --output none|<prefix>                       density, velocity and vorticity (none)\n"
+              << "  --output-interval <n>                        (10 outputs per run)\n"
+              << "  --output-format fields|series                VTK / XDMF files or one compressed series (fields)\n"
+              << "  --error-bound <e>                            of the series values, both fields (1e-6)\n"
+              << "  --density-error <e>                          of the series density (the error bound)\n"
+              << "  --velocity-error <e>                         of the series velocity (the error bound)\n"
+              << "  --checkpoint none|<file>                     continued from if it exists (none)\n"
+              << "  --checkpoint-interval <n>                    (10 checkpoints per run)\n"
+              << "  --images none|<prefix>                       png images while the run goes on (none)\n"
+              << "  --image-interval <n>                         (100 images per run)\n"
+              << "  --image-field speed|vorticity                (speed)");
+    exit(EXIT_FAILURE);
+}
+
 int main(int argc, char** argv)
 {	
-    if(argc < 2)
-        std::cerr<<"Insufficient number of input parameters"<<std::endl;
-
     // The program will terminate after printing error message.
-    assert(argc ==2);
+    if(argc < 2) {
+        LOG_ERROR("Insufficient number of input parameters");
+        usage(argv[0]);
+    }
 
     std::string s1("scenario1");
     std::string s2("scenario2");
 
     if(s1.compare(argv[1])  && s2.compare(argv[1])) {
 
-        std::cerr << "argv[1] must be scenario1 or scenario2!" << std::endl;
-        exit(EXIT_FAILURE);
+        LOG_ERROR("argv[1] must be scenario1 or scenario2!");
+        usage(argv[0]);
     }
 
-    std::cout<<" \n "<< std::endl;
-    std::cout << "Data successfully read!" << std::endl;
+    // The options after the scenario, each at most once
+    std::map<std::string, std::string> options;
+
+    for(int a=2; a< argc; ++a){
+
+        std::string name = argv[a];
+        if(name.compare(0, 2, "--") != 0) {
+            LOG_ERROR("Unexpected argument " << name << ", the options start with --");
+            usage(argv[0]);
+        }
+        name = name.substr(2);
+
+        std::string value;
+        const size_t equals = name.find('=');
+
+        if(equals != std::string::npos) {
+            value = name.substr(equals + 1);
+            name = name.substr(0, equals);
+        }
+        else if(a + 1 < argc)
+            value = argv[++a];
+        else {
+            LOG_ERROR("Option --" << name << " needs a value");
+            usage(argv[0]);
+        }
+
+        if(std::find(std::begin(optionNames), std::end(optionNames), name) == std::end(optionNames)) {
+            LOG_ERROR("Unknown option --" << name);
+            usage(argv[0]);
+        }
+        if(options.count(name)) {
+            LOG_ERROR("Option --" << name << " is given twice");
+            usage(argv[0]);
+        }
+
+        options[name] = value;
+    }
+
+    // Value of an option, fallback if it is not given
+    auto option = [&options](const std::string& name, const std::string& fallback) {
+        const std::map<std::string, std::string>::const_iterator it = options.find(name);
+        return it != options.end() ? it->second : fallback;
+    };
+
+    LOG_INFO("");
+    LOG_INFO("Data successfully read!");
 
 //    Lattice l1(2,2);
 //    l1(0, 0, C) = 1.5;
@@ -39,13 +239,169 @@ int main(int argc, char** argv)
     std::string arg = argv[1];
     Parameters param(arg);
     param.calcDomDim();
-    std::cout<< "Param Converted !"<< std::endl;
+    LOG_INFO("Param Converted !");
+
+    RunConfig config;
+
+    // nx and ny are real valued, round them to the nearest no. of cells
+    config.dimX = static_cast<size_t>(nx + 0.5);
+    config.dimY = static_cast<size_t>(ny + 0.5);
+
+    // Memory layout of the lattice, AoS by default
+    const std::string layout = option("layout", "aos");
 
-    Simulation sim(3,3);
-    sim.printLattice();
-    sim.setNoSlipBCs();
-    sim.printLattice();
+    if(layout != "aos" && layout != "soa" && layout != "aosoa4" && layout != "aosoa8") {
+        LOG_ERROR("Unknown layout " << layout << ", choose aos, soa, aosoa4 or aosoa8");
+        exit(EXIT_FAILURE);
+    }
+
+    // Two lattices by default, the AA pattern and the Esoteric Twist need only half the memory
+    const std::string prop = option("propagation", "twolattice");
+    config.propagation = twoLattice;
+
+    if(prop == "aa") config.propagation = aaPattern;
+    else if(prop == "esotwist") config.propagation = esoTwist;
+    else if(prop != "twolattice") {
+        LOG_ERROR("Unknown propagation " << prop << ", choose twolattice, aa or esotwist");
+        exit(EXIT_FAILURE);
+    }
+
+    // No tiling by default
+    const std::string tiling = option("tiling", "none");
+    config.tileX = 0;
+    config.tileY = 0;
+    config.autotune = (tiling == "auto");
+
+    if(tiling != "none" && !config.autotune && sscanf(tiling.c_str(), "%zux%zu", &config.tileX, &config.tileY) != 2) {
+        LOG_ERROR("Unknown tiling " << tiling << ", choose none, auto or <width>x<height>");
+        exit(EXIT_FAILURE);
+    }
+
+    // One time step per pass by default, more need the two lattice propagation
+    config.blockSteps = positiveInteger("block-steps", option("block-steps", "1"));
+
+    // The cylinder of the scenario by default, a png mask is resized to the grid
+    const std::string geometry = option("geometry", "cylinder");
+    FlagField flags(config.dimX + 2, config.dimY + 2);
+
+    try {
+        param.buildGeometry(flags, geometry);
+    }
+    catch(const std::invalid_argument& e) {
+        LOG_ERROR(e.what());
+        exit(EXIT_FAILURE);
+    }
+
+    // BGK by default, the other operators are more stable at high Reynolds numbers
+    const std::string collide = option("collision", "bgk");
+    config.collision = bgk;
+
+    if(collide == "trt") config.collision = trt;
+    else if(collide == "mrt") config.collision = mrt;
+    else if(collide == "regularized") config.collision = regularized;
+    else if(collide == "cumulant") config.collision = cumulant;
+    else if(collide != "bgk") {
+        LOG_ERROR("Unknown collision " << collide << ", choose bgk, trt, mrt, regularized or cumulant");
+        exit(EXIT_FAILURE);
+    }
+
+    // No LES by default, C_s around 0.1 - 0.2 adds the Smagorinsky subgrid model to the collision
+    config.smagorinsky = number("smagorinsky", option("smagorinsky", "0"), true);
+
+    // No output by default. With a prefix the density, velocity and vorticity are written as VTK and
+    // XDMF files by a background thread, 10 times per run unless the interval says otherwise.
+    config.output = option("output", "none");
+    config.outputInterval = positiveInteger("output-interval", option("output-interval", std::to_string(std::max(size_t(1), timeSteps / 10))));
+
+    // No checkpoints by default. With a file the state is saved 10 times per run unless the interval
+    // says otherwise, and a run started with an existing checkpoint file continues from it.
+    config.checkpoint = option("checkpoint", "none");
+    config.checkpointInterval = positiveInteger("checkpoint-interval", option("checkpoint-interval", std::to_string(std::max(size_t(1), timeSteps / 10))));
+
+    // No images by default. With a prefix a png image of the speed (or vorticity) is rendered 100 times
+    // per run unless the interval says otherwise, downsampled to MAX_IMAGE_SIZE pixels per side.
+    config.images = option("images", "none");
+    config.imageInterval = positiveInteger("image-interval", option("image-interval", std::to_string(std::max(size_t(1), timeSteps / 100))));
+    const std::string shown = option("image-field", "speed");
+    config.imageField = imageSpeed;
+
+    if(shown == "vorticity") config.imageField = imageVorticity;
+    else if(shown != "speed") {
+        LOG_ERROR("Unknown image field " << shown << ", choose speed or vorticity");
+        exit(EXIT_FAILURE);
+    }
+
+    // The fields of every output as VTK and XDMF files by default. A series appends them to one file
+    // (<output prefix>.lbms), quantized to the error bound (1e-6 by default), delta coded and compressed.
+    const std::string kind = option("output-format", "fields");
+    config.outputFormats = vtkImageData | xdmfRaw;
+
+    if(kind == "series") config.outputFormats = compressedSeries;
+    else if(kind != "fields") {
+        LOG_ERROR("Unknown output format " << kind << ", choose fields or series");
+        exit(EXIT_FAILURE);
+    }
+
+    // One error bound for both fields, or one per field
+    const std::string error_bound = option("error-bound", "1e-6");
+    number("error-bound", error_bound, false);
+    config.series = SeriesSettings(number("density-error", option("density-error", error_bound), false),
+                                   number("velocity-error", option("velocity-error", error_bound), false));
+
+    // The sparse lattice stores the fluid cells only, by default it is used if many cells are
+    // obstacles. It always uses two lattices, without tiling, in SoA order. It writes no
+    // checkpoints and renders no images, the dense lattice is used if they are asked for.
+    const std::string lattice = option("lattice", "auto");
+    const bool denseOnly = config.checkpoint != "none" || config.images != "none";
+    bool sparse = false;
+
+    if(lattice == "sparse") sparse = true;
+    else if(lattice == "auto") sparse = flags.fluidFraction() < SPARSE_FLUID_FRACTION && !denseOnly;
+    else if(lattice != "dense") {
+        LOG_ERROR("Unknown lattice " << lattice << ", choose auto, dense or sparse");
+        exit(EXIT_FAILURE);
+    }
+
+    if(sparse && denseOnly) {
+        LOG_ERROR("The sparse lattice does not write checkpoints or render images, choose the dense or auto lattice to use them");
+        exit(EXIT_FAILURE);
+    }
+    // The options of the dense lattice the sparse one has no choice in
+    if(sparse) {
+        const char* const denseOptions[] = {"layout", "propagation", "tiling", "block-steps"};
+        const char* const defaults[] = {"aos", "twolattice", "none", "1"};
+
+        for(size_t k=0; k< 4; ++k)
+            if(option(denseOptions[k], defaults[k]) != defaults[k])
+                LOG_WARNING("--" << denseOptions[k] << " " << option(denseOptions[k], defaults[k])
+                            << " is ignored, the sparse lattice always uses two lattices in SoA order without tiling");
+    }
+    if(lattice == "auto" && denseOnly && flags.fluidFraction() < SPARSE_FLUID_FRACTION)
+        LOG_INFO("Lattice :dense for the checkpoints and images, despite the fluid fraction " << flags.fluidFraction());
+
+    // f_q's stored as double by default, float halves the memory traffic. Shifted floats store
+    // the deviation from the rest state and lose less precision.
+    const std::string storage = option("storage", "double");
+
+    try {
+        if(storage == "double")       runLattice<PlainStorage<double> >(sparse, layout, config, flags);
+        else if(storage == "float")   runLattice<PlainStorage<float> >(sparse, layout, config, flags);
+        else if(storage == "shifted") runLattice<ShiftedStorage<float> >(sparse, layout, config, flags);
+        else {
+            LOG_ERROR("Unknown storage " << storage << ", choose double, float or shifted");
+            exit(EXIT_FAILURE);
+        }
+    }
+    catch(const std::runtime_error& e) {
+        LOG_ERROR(e.what());
+        exit(EXIT_FAILURE);
+    }
+    catch(const std::invalid_argument& e) {
+        LOG_ERROR(e.what());
+        exit(EXIT_FAILURE);
+    }
+
+    LOG_INFO("Simulation finished after " << timeSteps << " time steps");
 
     return 0;
 }
-
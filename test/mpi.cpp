@@ -0,0 +1,133 @@
+#include "Parameters.hpp"
+#include "DistributedSimulation.hpp"
+#include "FieldWriter.hpp"
+#include "Log.hpp"
+#include <mpi.h>
+#include <cstdio>     // sscanf
+#include <memory>     // std::unique_ptr
+#include <stdexcept>
+
+real nx, ny;
+real latticeVisc, latticeAcc;
+real relaxRate; //relaxation rate
+size_t timeSteps;
+
+
+// Runs the whole scenario on the blocks of all ranks with the given storage type, the fields
+// of the last time step are written to files starting with output unless it is none
+template<typename Storage>
+void run(const FlagField& flags, const CollisionModel& collision, const int& blocks_x, const int& blocks_y, const std::string& output)
+{
+    DistributedSimulation<Storage> sim(flags, MPI_COMM_WORLD, collision, 0.0, blocks_x, blocks_y);
+
+    // The channel is driven by the acceleration of the scenario
+    sim.setAcceleration(latticeAcc, 0.0);
+    sim.runSimulation();
+
+    if(output == "none")
+        return;
+
+    // Gathered on rank 0, which writes them
+    std::unique_ptr<FieldWriter> writer;
+    FieldSnapshot gathered;
+    if(sim.rank() == 0)
+        writer.reset(new FieldWriter(output));
+
+    sim.macroscopicFields(writer ? writer->acquire() : gathered);
+
+    if(writer) {
+        writer->submit();
+        writer->flush();
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    MPI_Init(&argc, &argv);
+
+    // Rank 0 speaks for all of them
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if(rank != 0)
+        setLogLevel(logWarning);
+
+    if(argc < 2 || argc > 7) {
+        LOG_ERROR("Insufficient number of input parameters");
+        LOG_ERROR("Usage: mpirun -np <ranks> " << argv[0] << " scenario1|scenario2 [double|float|shifted] [cylinder|none|<mask.png>] [bgk|trt|mrt|regularized|cumulant] [auto|<blocks x>x<blocks y>] [none|<output prefix>]");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    std::string s1("scenario1");
+    std::string s2("scenario2");
+
+    if(s1.compare(argv[1])  && s2.compare(argv[1])) {
+
+        LOG_ERROR("argv[1] must be scenario1 or scenario2!");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    std::string arg = argv[1];
+    Parameters param(arg);
+    param.calcDomDim();
+
+    // nx and ny are real valued, round them to the nearest no. of cells
+    const size_t dim_x = static_cast<size_t>(nx + 0.5);
+    const size_t dim_y = static_cast<size_t>(ny + 0.5);
+
+    // Every rank builds the whole geometry and keeps its block of it
+    const std::string geometry = argc >= 4 ? argv[3] : "cylinder";
+    FlagField flags(dim_x + 2, dim_y + 2);
+
+    try {
+        param.buildGeometry(flags, geometry);
+    }
+    catch(const std::invalid_argument& e) {
+        LOG_ERROR(e.what());
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    const std::string collide = argc >= 5 ? argv[4] : "bgk";
+    CollisionModel collision = bgk;
+
+    if(collide == "trt") collision = trt;
+    else if(collide == "mrt") collision = mrt;
+    else if(collide == "regularized") collision = regularized;
+    else if(collide == "cumulant") collision = cumulant;
+    else if(collide != "bgk") {
+        LOG_ERROR("Unknown collision " << collide << ", choose bgk, trt, mrt, regularized or cumulant");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    // The split with the shortest halos by default
+    const std::string split = argc >= 6 ? argv[5] : "auto";
+    int blocks_x = 0, blocks_y = 0;
+
+    if(split != "auto" && sscanf(split.c_str(), "%dx%d", &blocks_x, &blocks_y) != 2) {
+        LOG_ERROR("Unknown split " << split << ", choose auto or <blocks x>x<blocks y>");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    const std::string output = argc >= 7 ? argv[6] : "none";
+
+    const std::string storage = argc >= 3 ? argv[2] : "double";
+
+    try {
+        if(storage == "double")       run<PlainStorage<double> >(flags, collision, blocks_x, blocks_y, output);
+        else if(storage == "float")   run<PlainStorage<float> >(flags, collision, blocks_x, blocks_y, output);
+        else if(storage == "shifted") run<ShiftedStorage<float> >(flags, collision, blocks_x, blocks_y, output);
+        else {
+            LOG_ERROR("Unknown storage " << storage << ", choose double, float or shifted");
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+    }
+    catch(const std::invalid_argument& e) {
+        LOG_ERROR(e.what());
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    LOG_INFO("Simulation finished after " << timeSteps << " time steps");
+
+    MPI_Finalize();
+    return 0;
+}
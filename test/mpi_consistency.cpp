@@ -0,0 +1,89 @@
+#include "Parameters.hpp"
+#include "Simulation.hpp"
+#include "DistributedSimulation.hpp"
+#include "Log.hpp"
+#include "Deviation.hpp"
+#include <mpi.h>
+#include <iostream>
+#include <string>
+
+real nx, ny;
+real latticeVisc, latticeAcc;
+real relaxRate; //relaxation rate
+size_t timeSteps;
+
+
+// Checks that the MPI backend computes the same flow as the serial two lattice SoA reference,
+// for the split with the shortest halos and for strips along x and y. The channel is the one
+// of consistency.cpp. Exits with a failure on every rank if a split is off by more than the
+// rounding of the snapshot floats.
+
+static const size_t dimX = 64;
+static const size_t dimY = 32;
+static const size_t steps = 300;
+
+
+int main(int argc, char** argv)
+{
+    MPI_Init(&argc, &argv);
+
+    // Only the failures are of interest
+    setLogLevel(logWarning);
+
+    int numRanks;
+    MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+
+    relaxRate = 1.8;
+    latticeAcc = 1e-5;
+
+    FlagField flags(dimX + 2, dimY + 2);
+    flags.addCylinder(16.0, 15.3, 5.0);
+
+    // Computed by the rank the fields are gathered on, rank 0 of the Cartesian communicator,
+    // which need not be the one of MPI_COMM_WORLD as the ranks may be reordered
+    FieldSnapshot reference;
+
+    // Blocks in x and y, 0 x 0 for the split with the shortest halos, the strips with the other
+    // count derived from the ranks
+    const int splits[3][2] = {{0, 0}, {numRanks, 0}, {0, numRanks}};
+    const double tolerance = 1e-6;
+    int failed = 0;
+
+    for(size_t s=0; s< 3; ++s){
+
+        FieldSnapshot fields;
+        std::string name;
+        bool gathered;
+        {
+            DistributedSimulation<PlainStorage<double> > sim(flags, MPI_COMM_WORLD, bgk, 0.0, splits[s][0], splits[s][1]);
+            sim.setAcceleration(latticeAcc, 0.0);
+            sim.advance(steps);
+            sim.macroscopicFields(fields);
+            name = std::to_string(sim.blocksX()) + " x " + std::to_string(sim.blocksY()) + " blocks";
+            gathered = sim.rank() == 0;
+        }
+
+        if(!gathered)
+            continue;
+
+        if(reference.density.empty()) {
+            Simulation<SoA, PlainStorage<double> > sim(dimX, dimY);
+            sim.setGeometry(flags);
+            sim.setAcceleration(latticeAcc, 0.0);
+            sim.advance(steps);
+            sim.macroscopicFields(reference);
+        }
+
+        const double error = deviation(reference, fields);
+        const bool ok = error <= tolerance;
+        failed += !ok;
+
+        std::cout << (ok ? "ok     " : "FAILED ") << name << " :deviation " << error << " (tolerance " << tolerance << ")" << std::endl;
+    }
+
+    // Counted by the gathering ranks only
+    MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Finalize();
+
+    return failed ? 1 : 0;
+}
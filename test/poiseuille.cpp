@@ -0,0 +1,84 @@
+#include "Parameters.hpp"
+#include "Simulation.hpp"
+#include "Log.hpp"
+#include <cmath>      // std::sqrt
+#include <iostream>
+
+real nx, ny;
+real latticeVisc, latticeAcc;
+real relaxRate; //relaxation rate
+size_t timeSteps;
+
+
+// Checks the collision operators against the Poiseuille flow: a channel between the no slip
+// walls, periodic in x and driven by the body acceleration g, relaxes to the parabola
+//     u_x(y) = g / (2 nu) y (H - y),   nu = (1/omega - 1/2) / 3
+// with the walls halfway between the ghost cells and the first fluid cells (y = 0 and y = H,
+// cell j at y = j + 1/2). TRT and MRT place the wall there exactly for any viscosity (magic
+// parameter 3/16), BGK, regularized and cumulant up to a slip that grows with 1/omega.
+// Exits with a failure if the relative L2 error of a profile exceeds its tolerance.
+
+static const size_t dimX = 16;
+static const size_t dimY = 32;
+static const size_t steps = 12000;
+
+// Relative L2 error of the steady profile of the collision operator
+static double profileError(const CollisionModel& collision)
+{
+    Simulation<SoA, PlainStorage<double> > sim(dimX, dimY, twoLattice, collision);
+    sim.setAcceleration(latticeAcc, 0.0);
+    sim.advance(steps);
+
+    FieldSnapshot fields;
+    sim.macroscopicFields(fields);
+
+    const double nu = (1.0 / relaxRate - 0.5) / 3.0;
+    double error = 0.0, norm = 0.0;
+
+    for(size_t j=0; j< dimY; ++j){
+
+        const double y = j + 0.5;
+        const double exact = latticeAcc / (2.0 * nu) * y * (dimY - y);
+
+        for(size_t i=0; i< dimX; ++i){
+            const double u = fields.velocity[3*(j*dimX + i)];
+            const double v = fields.velocity[3*(j*dimX + i) + 1];
+            error += (u - exact) * (u - exact) + v * v;
+            norm += exact * exact;
+        }
+    }
+
+    return std::sqrt(error / norm);
+}
+
+
+int main()
+{
+    // Only the failures are of interest
+    setLogLevel(logWarning);
+
+    // nu = 0.1, the profile settles within the run (e-folding time H^2 / (pi^2 nu) ~ 1000 steps)
+    // at a maximum speed of 0.013
+    relaxRate = 1.25;
+    latticeAcc = 1e-5;
+
+    struct Check {
+        CollisionModel collision;
+        double tolerance;
+    };
+
+    const Check checks[] = {{bgk, 2e-3}, {trt, 1e-4}, {mrt, 1e-4}, {regularized, 2e-3}, {cumulant, 2e-3}};
+
+    bool passed = true;
+    for(const Check& c : checks){
+
+        const double error = profileError(c.collision);
+        const bool ok = error <= c.tolerance;
+        passed = passed && ok;
+
+        std::cout << (ok ? "ok     " : "FAILED ") << collisionName(c.collision) << " :L2 error " << error
+                  << " (tolerance " << c.tolerance << ")" << std::endl;
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,65 @@
+#include "FieldSeries.hpp"
+#include "FieldWriter.hpp"
+#include "Log.hpp"
+#include <cmath>      // sqrt
+#include <algorithm>  // std::max
+#include <memory>     // std::unique_ptr
+#include <stdexcept>
+
+
+// Reads a series file written by the series output of lbm frame by frame. Prints the time
+// step, the mean density and the maximum speed of every frame, with an output prefix the
+// frames are converted to VTK and XDMF files.
+int main(int argc, char** argv)
+{
+    if(argc < 2 || argc > 3) {
+        LOG_ERROR("Usage: " << argv[0] << " <series file> [none|<output prefix>]");
+        exit(EXIT_FAILURE);
+    }
+
+    const std::string output = argc >= 3 ? argv[2] : "none";
+
+    try {
+        SeriesReader reader(argv[1]);
+        const SeriesHeader& header = reader.header();
+
+        LOG_INFO("Series :" << header.sizeX << " x " << header.sizeY << " cells (spacing " << header.spacing << "), error bounds "
+                 << header.densityError << " (density), " << header.velocityError << " (velocity)");
+
+        std::unique_ptr<FieldWriter> writer;
+        if(output != "none")
+            writer.reset(new FieldWriter(output));
+
+        FieldSnapshot frame;
+        while(reader.next(frame)) {
+
+            double density = 0.0, speed = 0.0;
+            size_t numFluid = 0;
+
+            for(size_t c=0; c< frame.sizeX * frame.sizeY; ++c){
+                if(!frame.fluid[c])
+                    continue;
+
+                const double ux = frame.velocity[3*c], uy = frame.velocity[3*c + 1];
+                density += frame.density[c];
+                speed = std::max(speed, std::sqrt(ux*ux + uy*uy));
+                ++numFluid;
+            }
+
+            LOG_INFO("Time step " << frame.timeStep << " :mean density " << density / std::max(size_t(1), numFluid) << ", max. speed " << speed);
+
+            if(writer) {
+                writer->acquire() = frame;
+                writer->submit();
+            }
+        }
+
+        LOG_INFO("Frames :" << reader.framesRead());
+    }
+    catch(const std::runtime_error& e) {
+        LOG_ERROR(e.what());
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
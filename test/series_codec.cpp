@@ -0,0 +1,196 @@
+#include "FieldSeries.hpp"
+#include "FieldWriter.hpp"
+#include "Log.hpp"
+#include <cmath>      // std::sin, std::cos, std::fabs
+#include <cstdio>     // std::remove
+#include <algorithm>  // std::max
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>   // truncate
+
+
+// Checks the compressed series: frames written, appended to after the writer is reopened and
+// after the last frame is cut off, must read back with every field within its error bound, in
+// the right order and number. Key frames every 3 frames mix key frames and differences in
+// every part of the series. A writer for another geometry, size or error bounds must be
+// rejected without touching the file. A writer reopening the series for an earlier time step
+// (a restart from an older checkpoint, a new run) must replace the frames from there on, so
+// the time steps keep increasing.
+// The fields are a slowly moving wave with noise in the last bits of the floats, so the
+// values are not near the multiples of the quantization step.
+
+static const size_t sizeX = 61;
+static const size_t sizeY = 37;
+static const real densityError = 1e-6;
+static const real velocityError = 3e-7;
+static const size_t keyframes = 3;
+
+static void makeFrame(FieldSnapshot& frame, const size_t& t, const size_t& obstacleX, std::mt19937& random)
+{
+    std::uniform_real_distribution<double> noise(-1e-5, 1e-5);
+
+    frame.resize(sizeX, sizeY);
+    frame.timeStep = 100 * t;
+
+    for(size_t j=0; j< sizeY; ++j){
+        for(size_t i=0; i< sizeX; ++i){
+            const size_t c = j*sizeX + i;
+            const double wave = std::sin(0.3*i + 0.05*t) * std::cos(0.2*j);
+
+            frame.fluid[c] = (i < obstacleX || i > obstacleX + 4 || j < 15 || j > 21) ? 1 : 0;
+            if(!frame.fluid[c])
+                continue;
+
+            frame.density[c] = float(1.0 + 0.02*wave + noise(random));
+            frame.velocity[3*c] = float(0.05 + 0.01*wave + noise(random));
+            frame.velocity[3*c + 1] = float(-0.03*wave + noise(random));
+        }
+    }
+}
+
+// Frames first ... last - 1, replacing those of the series from the time step of the first on
+static void append(const std::string& path, const std::vector<FieldSnapshot>& frames, const size_t& first, const size_t& last)
+{
+    SeriesWriter writer(path, frames[first], SeriesSettings(densityError, velocityError, keyframes), frames[first].timeStep);
+    for(size_t t=first; t< last; ++t)
+        writer.append(frames[t]);
+}
+
+// A writer that must not fit the series, true if it is rejected
+static bool rejected(const std::string& path, const FieldSnapshot& frame, const SeriesSettings& settings)
+{
+    try {
+        SeriesWriter writer(path, frame, settings, frame.timeStep);
+        writer.append(frame);
+        return false;
+    }
+    catch(const std::runtime_error&) {
+        return true;
+    }
+}
+
+// The series against the expected frames, true if all are there, with increasing time steps,
+// and within the bounds
+static bool checkSeries(const std::string& path, const std::vector<const FieldSnapshot*>& expected, double& densityWorst, double& velocityWorst)
+{
+    SeriesReader reader(path);
+    FieldSnapshot frame;
+
+    densityWorst = velocityWorst = 0.0;
+    size_t numFrames = 0;
+
+    while(reader.next(frame)) {
+        if(numFrames >= expected.size())
+            return false;
+
+        if(numFrames > 0 && frame.timeStep <= expected[numFrames - 1]->timeStep)
+            return false;
+
+        const FieldSnapshot& reference = *expected[numFrames++];
+        if(frame.timeStep != reference.timeStep || frame.sizeX != sizeX || frame.sizeY != sizeY || frame.fluid != reference.fluid)
+            return false;
+
+        for(size_t c=0; c< sizeX * sizeY; ++c){
+            densityWorst = std::max(densityWorst, std::fabs(double(frame.density[c]) - reference.density[c]));
+            for(size_t d=0; d< 2; ++d)
+                velocityWorst = std::max(velocityWorst, std::fabs(double(frame.velocity[3*c + d]) - reference.velocity[3*c + d]));
+        }
+    }
+
+    return numFrames == expected.size() && densityWorst <= densityError && velocityWorst <= velocityError;
+}
+
+static void report(const bool& ok, const std::string& what, const double& densityWorst, const double& velocityWorst)
+{
+    std::cout << (ok ? "ok     " : "FAILED ") << what << " (worst error " << densityWorst << " density, " << velocityWorst << " velocity)"
+              << std::endl;
+}
+
+
+int main()
+{
+    // Only the failures are of interest, the cut off frame and the rejected writers are expected
+    setLogLevel(logOff);
+
+    const std::string path = "series_check.lbms";
+    std::remove(path.c_str());
+
+    std::mt19937 random(12345);
+    std::vector<FieldSnapshot> frames(11);
+    for(size_t t=0; t< frames.size(); ++t)
+        makeFrame(frames[t], t, 20, random);
+
+    bool passed = true;
+    double densityWorst = 0.0, velocityWorst = 0.0;
+    std::vector<const FieldSnapshot*> expected;
+
+    try {
+        // Written in two parts, the second continues the series
+        append(path, frames, 0, 5);
+        append(path, frames, 5, 8);
+        for(size_t t=0; t< 8; ++t)
+            expected.push_back(&frames[t]);
+
+        const bool appended = checkSeries(path, expected, densityWorst, velocityWorst);
+        report(appended, "8 frames, appended after a reopen", densityWorst, velocityWorst);
+
+        // Writers that don't fit
+        FieldSnapshot moved, small;
+        makeFrame(moved, 8, 30, random);
+        makeFrame(small, 8, 20, random);
+        small.resize(sizeX - 1, sizeY);
+
+        const bool mismatch = rejected(path, moved, SeriesSettings(densityError, velocityError, keyframes)) &&
+                              rejected(path, small, SeriesSettings(densityError, velocityError, keyframes)) &&
+                              rejected(path, frames[8], SeriesSettings(densityError, 2.0 * velocityError, keyframes)) &&
+                              checkSeries(path, expected, densityWorst, velocityWorst);
+        report(mismatch, "other geometry, size and error bound rejected, series unchanged", densityWorst, velocityWorst);
+
+        // The last frame cut off, it is dropped when the series is read and appended to
+        std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+        const off_t length = off_t(file.tellg());
+        file.close();
+        if(::truncate(path.c_str(), length - 10) != 0)
+            throw std::runtime_error("can't cut off the last frame of " + path);
+
+        expected.pop_back();
+        const bool cutOff = checkSeries(path, expected, densityWorst, velocityWorst);
+        report(cutOff, "7 frames, the cut off one dropped", densityWorst, velocityWorst);
+
+        append(path, frames, 8, 11);
+        for(size_t t=8; t< 11; ++t)
+            expected.push_back(&frames[t]);
+
+        const bool continued = checkSeries(path, expected, densityWorst, velocityWorst);
+        report(continued, "10 frames, appended after the cut off one", densityWorst, velocityWorst);
+
+        // Restarted from a checkpoint before the last frames, they are written again
+        append(path, frames, 6, 11);
+        expected.clear();
+        for(size_t t=0; t< 11; ++t)
+            expected.push_back(&frames[t]);
+
+        const bool restarted = checkSeries(path, expected, densityWorst, velocityWorst);
+        report(restarted, "11 frames, the ones from time step 600 on replaced", densityWorst, velocityWorst);
+
+        // A new run replaces them all
+        append(path, frames, 0, 3);
+        expected.resize(3);
+
+        const bool started = checkSeries(path, expected, densityWorst, velocityWorst);
+        report(started, "3 frames of a new run", densityWorst, velocityWorst);
+
+        passed = appended && mismatch && cutOff && continued && restarted && started;
+    }
+    catch(const std::runtime_error& e) {
+        std::cout << "FAILED " << e.what() << std::endl;
+        passed = false;
+    }
+
+    std::remove(path.c_str());
+    return passed ? 0 : 1;
+}